@@ -0,0 +1,178 @@
+/**********************************************************************************************/
+/* The MIT License                                                                            */
+/*                                                                                            */
+/* Copyright 2016-2017 Twitch Interactive, Inc. or its affiliates. All Rights Reserved.       */
+/*                                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy               */
+/* of this software and associated documentation files (the "Software"), to deal              */
+/* in the Software without restriction, including without limitation the rights               */
+/* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell                  */
+/* copies of the Software, and to permit persons to whom the Software is                      */
+/* furnished to do so, subject to the following conditions:                                   */
+/*                                                                                            */
+/* The above copyright notice and this permission notice shall be included in                 */
+/* all copies or substantial portions of the Software.                                        */
+/*                                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR                 */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,                   */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE                */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER                     */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,              */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN                  */
+/* THE SOFTWARE.                                                                              */
+/**********************************************************************************************/
+// Compares the original byte at a time find_start_code with the SIMD scanner in mpeg.c
+// on an Annex B H.264 elementary stream. Build from the repo root with
+//
+//     cc -O2 -Isrc -o start_code_bench bench/start_code_bench.c src/caption.c src/cea708.c src/dtvcc.c src/eia608.c src/eia608_charmap.c src/eia608_from_utf8.c src/trace.c src/utf8.c
+//
+// and run on a real capture, for example one extracted with
+//
+//     ffmpeg -i input.ts -c:v copy -bsf:v h264_mp4toannexb -f h264 sample.h264
+//     ./start_code_bench sample.h264
+//
+// Add -mavx2 to build the AVX2 scanner, or -mno-sse2 (32 bit x86) for the scalar one.
+
+// The scanner is static, so build it into this file
+#include "../src/mpeg.c"
+#include <time.h>
+
+#define BENCH_RUNS 10
+
+// find_start_code before it was vectorized, kept verbatim
+static size_t find_start_code_old(const uint8_t* data, size_t size)
+{
+    uint32_t start_code = 0xffffffff;
+    for (size_t i = 1; i < size; ++i) {
+        start_code = (start_code << 8) | data[i];
+        if (0x00000100 == (start_code & 0xffffff00)) {
+            return i - 3;
+        }
+    }
+    return 0;
+}
+
+// Walks every NALU in data, returns how many were found
+static size_t scan_old(const uint8_t* data, size_t size)
+{
+    size_t pos = 0, scpos, count = 0;
+
+    while ((scpos = find_start_code_old(&data[pos], size - pos))) {
+        pos += scpos, ++count;
+    }
+
+    return count;
+}
+
+static size_t scan_new(const uint8_t* data, size_t size)
+{
+    size_t pos = 0, scpos, count = 0;
+
+    while ((scpos = find_start_code(&data[pos], size - pos, 1))) {
+        pos += scpos, ++count;
+    }
+
+    return count;
+}
+
+// How mpeg_bitstream_parse sees a stream: NALUs arriving a TS payload (184 bytes) at a time.
+// The old parser rescanned the buffered NALU from the start after every payload
+static size_t feed_old(const uint8_t* data, size_t size)
+{
+    size_t pos = 0, have = 0, scpos, count = 0;
+
+    while (have < size) {
+        have = have + 184 < size ? have + 184 : size;
+
+        while ((scpos = find_start_code_old(&data[pos], have - pos))) {
+            pos += scpos, ++count;
+        }
+    }
+
+    return count;
+}
+
+static size_t feed_new(const uint8_t* data, size_t size)
+{
+    size_t pos = 0, have = 0, scan = 1, scpos, count = 0;
+
+    while (have < size) {
+        have = have + 184 < size ? have + 184 : size;
+
+        while ((scpos = find_start_code(&data[pos], have - pos, scan))) {
+            pos += scpos, scan = 1, ++count;
+        }
+
+        scan = 3 < have - pos ? have - pos - 3 : 1;
+    }
+
+    return count;
+}
+
+static double bench(const char* name, size_t (*scan)(const uint8_t*, size_t), const uint8_t* data, size_t size, size_t* count)
+{
+    int i;
+    double best = 0;
+
+    for (i = 0; i < BENCH_RUNS; ++i) {
+        clock_t start = clock();
+        (*count) = scan(data, size);
+        double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+        best = (0 == i || seconds < best) ? seconds : best;
+    }
+
+    printf("%-10s %8zu NALUs %9.3f ms %8.2f MB/s\n", name, *count, best * 1000.0, 0 < best ? size / best / 1000000.0 : 0);
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    FILE* file;
+    uint8_t* data;
+    long size;
+    size_t count_old, count_new;
+
+    if (2 > argc || !(file = fopen(argv[1], "rb"))) {
+        printf("usage: %s sample.h264\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    if (0 >= size || !(data = (uint8_t*)malloc(size)) || (size_t)size != fread(data, 1, size, file)) {
+        printf("Failed to read %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    fclose(file);
+
+#if defined(MPEG_SIMD_AVX2)
+    printf("%s: %ld bytes, AVX2 scanner\n", argv[1], size);
+#elif defined(MPEG_SIMD_SSE2)
+    printf("%s: %ld bytes, SSE2 scanner\n", argv[1], size);
+#else
+    printf("%s: %ld bytes, scalar scanner\n", argv[1], size);
+#endif
+
+    double old_scan = bench("scan old", scan_old, data, size, &count_old);
+    double new_scan = bench("scan new", scan_new, data, size, &count_new);
+
+    if (count_old != count_new) {
+        printf("NALU counts differ\n");
+        return EXIT_FAILURE;
+    }
+
+    double old_feed = bench("feed old", feed_old, data, size, &count_old);
+    double new_feed = bench("feed new", feed_new, data, size, &count_new);
+
+    if (count_old != count_new) {
+        printf("NALU counts differ\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("scan %.1fx faster, feed %.1fx faster\n", 0 < new_scan ? old_scan / new_scan : 0, 0 < new_feed ? old_feed / new_feed : 0);
+    free(data);
+    return EXIT_SUCCESS;
+}
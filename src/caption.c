@@ -23,13 +23,25 @@
 /**********************************************************************************************/
 #include "caption.h"
 #include "eia608.h"
+#include "trace.h"
 #include "utf8.h"
 #include <stdio.h>
 #include <string.h>
+#define CAPTION_FRAME_ROWS_MASK ((1 << SCREEN_ROWS) - 1)
 ////////////////////////////////////////////////////////////////////////////////
 void caption_frame_buffer_clear(caption_frame_buffer_t* buff)
 {
-    memset(buff, 0, sizeof(caption_frame_buffer_t));
+    buff->rows = 0;
+}
+
+static void caption_frame_buffer_init(caption_frame_buffer_t* buff)
+{
+    int r;
+    for (r = 0; r < SCREEN_ROWS; ++r) {
+        buff->row[r] = (uint8_t)r;
+    }
+
+    caption_frame_buffer_clear(buff);
 }
 
 
@@ -37,35 +49,73 @@ void caption_frame_init(caption_frame_t* frame)
 {
     //xds_init(&frame->xds);
     frame->write = 0;
+    frame->dirty = 0;
     frame->timestamp = -1;
-    frame->state = (caption_frame_state_t){ 0, 0, 0, SCREEN_ROWS - 1, 0, 0 }; // clear global state
-    caption_frame_buffer_clear(&frame->back);
-    caption_frame_buffer_clear(&frame->front);
+    frame->channel = 0;
+    frame->state = (caption_frame_state_t){ 0, 0, 0, SCREEN_ROWS - 1, 0, 0, 0 }; // clear global state
+    frame->front = &frame->buffer[0];
+    frame->back = &frame->buffer[1];
+    caption_frame_buffer_init(frame->back);
+    caption_frame_buffer_init(frame->front);
+}
+
+void caption_frame_init_channel(caption_frame_t* frame, int channel)
+{
+    caption_frame_init(frame);
+    frame->channel = (uint8_t)(channel & 0x03);
+}
+
+void caption_channels_init(caption_channels_t* channels)
+{
+    int i;
+    for (i = 0; i < CAPTION_CHANNELS; ++i) {
+        caption_frame_init_channel(&channels->frame[i], i);
+    }
+
+    channels->ready = 0;
+    channels->error = 0;
+    channels->dtvcc = 0;
 }
 ////////////////////////////////////////////////////////////////////////////////
 // Helpers
+// Returns 0 for cells in rows that have been cleared
 static caption_frame_cell_t* frame_buffer_cell(caption_frame_buffer_t* buff, int row, int col)
 {
-    if (!buff || 0 > row || SCREEN_ROWS <= row || 0 > col || SCREEN_COLS <= col) {
+    if (!buff || 0 > row || SCREEN_ROWS <= row || 0 > col || SCREEN_COLS <= col || !(buff->rows & (1 << buff->row[row]))) {
         return 0;
     }
 
-    return &buff->cell[row][col];
+    return &buff->cell[buff->row[row]][col];
 }
 
-uint16_t _eia608_from_utf8(const char* s); // function is in eia608.c.re2c
-int caption_frame_write_char(caption_frame_t* frame, int row, int col, eia608_style_t style, int underline, const char* c)
+// Like frame_buffer_cell, but zeros the row first if it has been cleared
+static caption_frame_cell_t* frame_buffer_cell_write(caption_frame_buffer_t* buff, int row, int col)
 {
-
-	//printf("char:%c ",c[0]);
-    if (!frame->write || !_eia608_from_utf8(c)) {
+    if (!buff || 0 > row || SCREEN_ROWS <= row || 0 > col || SCREEN_COLS <= col) {
         return 0;
     }
 
-    //printf("%c row:%d col:%d\n",c[0],row,col);
-    caption_frame_cell_t* cell = frame_buffer_cell(frame->write, row, col);
+    row = buff->row[row];
+    if (!(buff->rows & (1 << row))) {
+        memset(&buff->cell[row][0], 0, sizeof(caption_frame_cell_t) * SCREEN_COLS);
+        buff->rows |= (uint16_t)(1 << row);
+    }
+
+    return &buff->cell[row][col];
+}
+
+// idx must be a valid eia608_char_map index. The decoder already has one, so only
+// external callers pay for the utf8 lookup in caption_frame_write_char
+static int _caption_frame_write_index(caption_frame_t* frame, int row, int col, eia608_style_t style, int underline, int idx)
+{
+    caption_frame_cell_t* cell = frame_buffer_cell_write(frame->write, row, col);
+
+    if (cell) {
+        if (frame->write == frame->front) {
+            frame->dirty |= (uint16_t)(1 << row);
+        }
 
-    if (cell && utf8_char_copy(&cell->data[0], c)) {
+        cell->chr = (uint8_t)(idx + 1);
         cell->uln = underline;
         cell->sty = style;
         return 1;
@@ -74,10 +124,22 @@ int caption_frame_write_char(caption_frame_t* frame, int row, int col, eia608_st
     return 0;
 }
 
+uint16_t _eia608_from_utf8(const char* s); // function is in eia608.c.re2c
+int caption_frame_write_char(caption_frame_t* frame, int row, int col, eia608_style_t style, int underline, const char* c)
+{
+    int chan, c1, c2;
+
+    if (!frame->write || !eia608_to_index(_eia608_from_utf8(c), &chan, &c1, &c2)) {
+        return 0;
+    }
+
+    return _caption_frame_write_index(frame, row, col, style, underline, c1);
+}
+
 const utf8_char_t* caption_frame_read_char(caption_frame_t* frame, int row, int col, eia608_style_t* style, int* underline)
 {
     // always read from front
-    caption_frame_cell_t* cell = frame_buffer_cell(&frame->front, row, col);
+    caption_frame_cell_t* cell = frame_buffer_cell(frame->front, row, col);
 
     if (!cell) {
         if (style) {
@@ -99,7 +161,7 @@ const utf8_char_t* caption_frame_read_char(caption_frame_t* frame, int row, int
         (*underline) = cell->uln;
     }
 
-    return &cell->data[0];
+    return cell->chr ? eia608_char_map[cell->chr - 1] : EIA608_CHAR_NULL;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -116,23 +178,26 @@ libcaption_stauts_t caption_frame_carriage_return(caption_frame_t* frame)
         return LIBCAPTION_OK;
     }
 
-    for (; r < SCREEN_ROWS; ++r) {
-        uint8_t* dst = (uint8_t*)frame_buffer_cell(frame->write, r - 1, 0);
-        uint8_t* src = (uint8_t*)frame_buffer_cell(frame->write, r - 0, 0);
-        memcpy(dst, src, sizeof(caption_frame_cell_t) * SCREEN_COLS);
+    // Rotate screen rows r-1 to the bottom up by one. The row scrolled off the top becomes the new, empty, bottom row
+    caption_frame_buffer_t* buff = frame->write;
+    uint8_t top = buff->row[r - 1];
+    memmove(&buff->row[r - 1], &buff->row[r], SCREEN_ROWS - r);
+    buff->row[SCREEN_ROWS - 1] = top;
+    buff->rows &= (uint16_t)~(1 << top);
+
+    if (buff == frame->front) {
+        frame->dirty |= (uint16_t)(CAPTION_FRAME_ROWS_MASK << (r - 1)) & CAPTION_FRAME_ROWS_MASK;
     }
 
     frame->state.col = 0;
-    caption_frame_cell_t* cell = frame_buffer_cell(frame->write, SCREEN_ROWS - 1, 0);
-    memset(cell, 0, sizeof(caption_frame_cell_t) * SCREEN_COLS);
     return LIBCAPTION_OK;
 }
 ////////////////////////////////////////////////////////////////////////////////
-libcaption_stauts_t eia608_write_char(caption_frame_t* frame, char* c)
+static libcaption_stauts_t _caption_frame_put_index(caption_frame_t* frame, int idx)
 {
-    if (0 == c || 0 == c[0] || SCREEN_ROWS <= frame->state.row || 0 > frame->state.row || SCREEN_COLS <= frame->state.col || 0 > frame->state.col) {
+    if (0 > idx || SCREEN_ROWS <= frame->state.row || 0 > frame->state.row || SCREEN_COLS <= frame->state.col || 0 > frame->state.col) {
         // NO-OP
-    } else if (caption_frame_write_char(frame, frame->state.row, frame->state.col, frame->state.sty, frame->state.uln, c)) {
+    } else if (_caption_frame_write_index(frame, frame->state.row, frame->state.col, frame->state.sty, frame->state.uln, idx)) {
         frame->state.col += 1;
     }
 
@@ -141,32 +206,29 @@ libcaption_stauts_t eia608_write_char(caption_frame_t* frame, char* c)
 
 libcaption_stauts_t caption_frame_end(caption_frame_t* frame)
 {
-    memcpy(&frame->front, &frame->back, sizeof(caption_frame_buffer_t));
-    caption_frame_buffer_clear(&frame->back); // This is required
+    caption_frame_buffer_t* front = frame->front;
+
+    // Swap displayed and non-displayed memory, write keeps pointing at the same role
+    frame->front = frame->back;
+    frame->back = front;
+
+    if (frame->write) {
+        frame->write = (frame->write == front) ? frame->front : frame->back;
+    }
+
+    caption_frame_buffer_clear(frame->back); // This is required
+    frame->dirty = CAPTION_FRAME_ROWS_MASK;
     return LIBCAPTION_READY;
 }
 
 
-const char style[8][64] = {
-    "eia608_style_white = 0",
-    "eia608_style_green = 1",
-    "eia608_style_blue = 2",
-    "eia608_style_cyan = 3",
-    "eia608_style_red = 4",
-    "eia608_style_yellow = 5",
-    "eia608_style_magenta = 6",
-    "eia608_style_italics = 7",
-} ;
-
 libcaption_stauts_t caption_frame_decode_preamble(caption_frame_t* frame, uint16_t cc_data)
 {
-
-	printf("caption_frame_decode_preamble() cc_data=0x%04X ",cc_data);
     eia608_style_t sty;
     int row, col, chn, uln;
 
     if (eia608_parse_preamble(cc_data, &row, &col, &sty, &chn, &uln)) {
-    	printf("row:%d col:%d underline:%d channel:%d style:%s\n", row, col, uln, chn, &style[sty][0]);
+        LIBCAPTION_TRACE(CAPTION, DEBUG, "preamble cc_data=0x%04X row:%d col:%d underline:%d channel:%d style:%s\n", cc_data, row, col, uln, chn, eia608_style_map[sty]);
         frame->state.row = row;
         frame->state.col = col;
         frame->state.sty = sty;
@@ -178,12 +240,11 @@ libcaption_stauts_t caption_frame_decode_preamble(caption_frame_t* frame, uint16
 
 libcaption_stauts_t caption_frame_decode_midrowchange(caption_frame_t* frame, uint16_t cc_data)
 {
-
-	printf("caption_frame_decode_midrowchange() cc_data=0x%04X\n",cc_data);
     eia608_style_t sty;
     int chn, unl;
 
     if (eia608_parse_midrowchange(cc_data, &chn, &sty, &unl)) {
+        LIBCAPTION_TRACE(CAPTION, DEBUG, "midrowchange cc_data=0x%04X style:%s\n", cc_data, eia608_style_map[sty]);
         frame->state.sty = sty;
         frame->state.uln = unl;
     }
@@ -193,7 +254,6 @@ libcaption_stauts_t caption_frame_decode_midrowchange(caption_frame_t* frame, ui
 
 libcaption_stauts_t caption_frame_backspace(caption_frame_t* frame)
 {
-	printf("caption_frame_backspace()\n");
     // do not reverse wrap (tw 28:20)
     frame->state.col = (0 < frame->state.col) ? (frame->state.col - 1) : 0;
     caption_frame_write_char(frame, frame->state.row, frame->state.col, eia608_style_white, 0, EIA608_CHAR_NULL);
@@ -218,71 +278,68 @@ libcaption_stauts_t caption_frame_delete_to_end_of_row(caption_frame_t* frame)
 
 libcaption_stauts_t caption_frame_decode_control(caption_frame_t* frame, uint16_t cc_data)
 {
-
-
     int cc;
     eia608_control_t cmd = eia608_parse_control(cc_data, &cc);
 
-    printf("caption_frame_decode_control() cmd=0x%04X ",cmd);
-
     switch (cmd) {
     // PAINT ON
     case eia608_control_resume_direct_captioning:
-    	printf("eia608_control_resume_direct_captioning\n");
+        LIBCAPTION_TRACE(CAPTION, DEBUG, "eia608_control_resume_direct_captioning cmd=0x%04X\n", cmd);
         frame->state.rup = 0;
-        frame->write = &frame->front;
+        frame->write = frame->front;
         return LIBCAPTION_OK;
 
     case eia608_control_erase_display_memory:
-    	printf("eia608_control_erase_display_memory\n");
-        caption_frame_buffer_clear(&frame->front);
+        LIBCAPTION_TRACE(CAPTION, DEBUG, "eia608_control_erase_display_memory cmd=0x%04X\n", cmd);
+        caption_frame_buffer_clear(frame->front);
+        frame->dirty = CAPTION_FRAME_ROWS_MASK;
         return LIBCAPTION_READY;
 
     // ROLL-UP
     case eia608_control_roll_up_2:
-    	printf("eia608_control_roll_up_2\n");
+        LIBCAPTION_TRACE(CAPTION, DEBUG, "eia608_control_roll_up_2 cmd=0x%04X\n", cmd);
         frame->state.rup = 1;
-        frame->write = &frame->front;
+        frame->write = frame->front;
         return LIBCAPTION_OK;
 
     case eia608_control_roll_up_3:
-    	printf("eia608_control_roll_up_3\n");
+        LIBCAPTION_TRACE(CAPTION, DEBUG, "eia608_control_roll_up_3 cmd=0x%04X\n", cmd);
         frame->state.rup = 2;
-        frame->write = &frame->front;
+        frame->write = frame->front;
         return LIBCAPTION_OK;
 
     case eia608_control_roll_up_4:
-    	printf("eia608_control_roll_up_4\n");
+        LIBCAPTION_TRACE(CAPTION, DEBUG, "eia608_control_roll_up_4 cmd=0x%04X\n", cmd);
         frame->state.rup = 3;
-        frame->write = &frame->front;
+        frame->write = frame->front;
         return LIBCAPTION_OK;
 
     case eia608_control_carriage_return:
-    	printf("eia608_control_carriage_return\n");
+        LIBCAPTION_TRACE(CAPTION, DEBUG, "eia608_control_carriage_return cmd=0x%04X\n", cmd);
         return caption_frame_carriage_return(frame);
 
     // Corrections (Is this only valid as part of paint on?)
     case eia608_control_backspace:
-    	printf("eia608_control_backspace\n");
+        LIBCAPTION_TRACE(CAPTION, DEBUG, "eia608_control_backspace cmd=0x%04X\n", cmd);
         return caption_frame_backspace(frame);
     case eia608_control_delete_to_end_of_row:
-    	printf("eia608_control_delete_to_end_of_row\n");
+        LIBCAPTION_TRACE(CAPTION, DEBUG, "eia608_control_delete_to_end_of_row cmd=0x%04X\n", cmd);
         return caption_frame_delete_to_end_of_row(frame);
 
     // POP ON
     case eia608_control_resume_caption_loading:
-    	printf("eia608_control_resume_caption_loading\n");
+        LIBCAPTION_TRACE(CAPTION, DEBUG, "eia608_control_resume_caption_loading cmd=0x%04X\n", cmd);
         frame->state.rup = 0;
-        frame->write = &frame->back;
+        frame->write = frame->back;
         return LIBCAPTION_OK;
 
     case eia608_control_erase_non_displayed_memory:
-    	printf("eia608_control_erase_non_displayed_memory\n");
-        caption_frame_buffer_clear(&frame->back);
+        LIBCAPTION_TRACE(CAPTION, DEBUG, "eia608_control_erase_non_displayed_memory cmd=0x%04X\n", cmd);
+        caption_frame_buffer_clear(frame->back);
         return LIBCAPTION_OK;
 
     case eia608_control_end_of_caption:
-    	printf("eia608_control_end_of_caption\n");
+        LIBCAPTION_TRACE(CAPTION, DEBUG, "eia608_control_end_of_caption cmd=0x%04X\n", cmd);
         return caption_frame_end(frame);
 
     // cursor positioning
@@ -290,7 +347,7 @@ libcaption_stauts_t caption_frame_decode_control(caption_frame_t* frame, uint16_
     case eia608_tab_offset_1:
     case eia608_tab_offset_2:
     case eia608_tab_offset_3:
-    	printf("eia608_tab_offset\n");
+        LIBCAPTION_TRACE(CAPTION, DEBUG, "eia608_tab_offset cmd=0x%04X\n", cmd);
         frame->state.col += (cmd - eia608_tab_offset_0);
         return LIBCAPTION_OK;
 
@@ -300,19 +357,15 @@ libcaption_stauts_t caption_frame_decode_control(caption_frame_t* frame, uint16_
     case eia608_control_alarm_on:
     case eia608_control_text_restart:
     case eia608_control_text_resume_text_display:
-    	printf("Unhandled\n");
+        LIBCAPTION_TRACE(CAPTION, INFO, "unhandled control 0x%04X\n", cmd);
         return LIBCAPTION_OK;
     }
 }
 
 libcaption_stauts_t caption_frame_decode_text(caption_frame_t* frame, uint16_t cc_data)
 {
-
-	//printf("caption_frame_decode_text() cc_data=0x%04X\n",cc_data);
-
-    int chan;
-    char char1[5], char2[5];
-    size_t chars = eia608_to_utf8(cc_data, &chan, &char1[0], &char2[0]);
+    int chan, c1, c2;
+    int chars = eia608_to_index(cc_data, &chan, &c1, &c2);
 
     if (eia608_is_westeu(cc_data)) {
         // Extended charcters replace the previous charcter for back compatibility
@@ -320,11 +373,11 @@ libcaption_stauts_t caption_frame_decode_text(caption_frame_t* frame, uint16_t c
     }
 
     if (0 < chars) {
-        eia608_write_char(frame, char1);
+        _caption_frame_put_index(frame, c1);
     }
 
     if (1 < chars) {
-        eia608_write_char(frame, char2);
+        _caption_frame_put_index(frame, c2);
     }
 
     return LIBCAPTION_OK;
@@ -332,12 +385,22 @@ libcaption_stauts_t caption_frame_decode_text(caption_frame_t* frame, uint16_t c
 
 libcaption_stauts_t caption_frame_decode(caption_frame_t* frame, uint16_t cc_data, double timestamp)
 {
-    if (!eia608_parity_varify(cc_data)) {
-        frame->status = LIBCAPTION_ERROR;
+    eia608_class_t type = eia608_classify(cc_data);
+
+    if (eia608_class_invalid == type) {
+        // The channel bit can't be trusted without parity, blame the data channel being sent
+        frame->status = (frame->channel & 1) == frame->state.chn ? LIBCAPTION_ERROR : LIBCAPTION_OK;
         return frame->status;
     }
 
-    if (eia608_is_padding(cc_data)) {
+    // Charcters belong to the data channel selected by the last code that carries a channel bit
+    if (eia608_class_control == type || eia608_class_preamble == type || eia608_class_midrowchange == type || eia608_class_specialna == type || eia608_class_westeu == type) {
+        frame->state.chn = eia608_test_second_channel_bit(cc_data) ? 1 : 0;
+    } else if (eia608_is_xds(cc_data)) {
+        frame->state.chn = 2;
+    }
+
+    if (eia608_class_padding == type || (frame->channel & 1) != frame->state.chn) {
         frame->status = LIBCAPTION_OK;
         return frame->status;
     }
@@ -348,17 +411,21 @@ libcaption_stauts_t caption_frame_decode(caption_frame_t* frame, uint16_t cc_dat
     }
 
     // skip duplicate controll commands. We also skip duplicate specialna to match the behaviour of iOS/vlc
-    if ((eia608_is_specialna(cc_data) || eia608_is_control(cc_data)) && cc_data == frame->state.cc_data) {
+    if ((eia608_class_specialna == type || eia608_class_control == type) && cc_data == frame->state.cc_data) {
         frame->status = LIBCAPTION_OK;
         return frame->status;
     }
 
     frame->state.cc_data = cc_data;
 
-    if (eia608_is_control(cc_data)) {
+    switch (type) {
+    case eia608_class_control:
         frame->status = caption_frame_decode_control(frame, cc_data);
-    } else if (eia608_is_basicna(cc_data) || eia608_is_specialna(cc_data) || eia608_is_westeu(cc_data)) {
+        break;
 
+    case eia608_class_basicna:
+    case eia608_class_specialna:
+    case eia608_class_westeu:
         // Don't decode text if we dont know what mode we are in.
         if (!frame->write) {
             frame->status = LIBCAPTION_OK;
@@ -371,10 +438,18 @@ libcaption_stauts_t caption_frame_decode(caption_frame_t* frame, uint16_t cc_dat
         if (LIBCAPTION_OK == frame->status && caption_frame_painton(frame)) {
             frame->status = LIBCAPTION_READY;
         }
-    } else if (eia608_is_preamble(cc_data)) {
+        break;
+
+    case eia608_class_preamble:
         frame->status = caption_frame_decode_preamble(frame, cc_data);
-    } else if (eia608_is_midrowchange(cc_data)) {
+        break;
+
+    case eia608_class_midrowchange:
         frame->status = caption_frame_decode_midrowchange(frame, cc_data);
+        break;
+
+    default:
+        break;
     }
 
     return frame->status;
@@ -382,33 +457,58 @@ libcaption_stauts_t caption_frame_decode(caption_frame_t* frame, uint16_t cc_dat
 
 
 ////////////////////////////////////////////////////////////////////////////////
+// Walks the row's cells directly, rows that were cleared render as empty
+static size_t _caption_frame_row_to_text(caption_frame_buffer_t* buff, int row, utf8_char_t* data)
+{
+    int c;
+    size_t s, size = 0;
+    caption_frame_cell_t* cell = frame_buffer_cell(buff, row, 0);
+    (*data) = '\0';
+
+    if (!cell) {
+        return 0;
+    }
+
+    for (c = 0; c < SCREEN_COLS; ++c, ++cell) {
+        // dont start a new line until we encounter at least one printable character
+        if (cell->chr && (0 < size || !utf8_char_whitespace(eia608_char_map[cell->chr - 1]))) {
+            s = utf8_char_copy(data, eia608_char_map[cell->chr - 1]);
+            data += s, size += s;
+        }
+    }
+
+    return size;
+}
+
+size_t caption_frame_row_to_text(caption_frame_t* frame, int row, utf8_char_t* data)
+{
+    if (0 > row || SCREEN_ROWS <= row) {
+        (*data) = '\0';
+        return 0;
+    }
+
+    frame->dirty &= (uint16_t)~(1 << row);
+    return _caption_frame_row_to_text(frame->front, row, data);
+}
+
 size_t caption_frame_to_text(caption_frame_t* frame, utf8_char_t* data)
 {
-    int r, c, uln, crlf = 0, count = 0;
+    int r;
     size_t s, size = 0;
-    eia608_style_t sty;
     (*data) = '\0';
 
     for (r = 0; r < SCREEN_ROWS; ++r) {
-        crlf += count, count = 0;
-        for (c = 0; c < SCREEN_COLS; ++c) {
-            const utf8_char_t* chr = caption_frame_read_char(frame, r, c, &sty, &uln);
-            // dont start a new line until we encounter at least one printable character
-            if (0 < utf8_char_length(chr) && (0 < count || !utf8_char_whitespace(chr))) {
-                if (0 < crlf) {
-                    //memcpy(data, "\r\n\0", 3);
-                    //data += 2, size += 2, crlf = 0;
-
-                    memcpy(data, "\n\0", 2);
-                    data += 1, size += 1, crlf = 0;
-                }
-
-                s = utf8_char_copy(data, chr);
-                data += s, size += s, ++count;
-            }
+        if (0 == size) {
+            size = _caption_frame_row_to_text(frame->front, r, data);
+        } else if (0 < (s = _caption_frame_row_to_text(frame->front, r, data + size + 1))) {
+            data[size] = '\n';
+            size += 1 + s;
+        } else {
+            data[size] = '\0';
         }
     }
 
+    frame->dirty = 0;
     return size;
 }
 ////////////////////////////////////////////////////////////////////////////////
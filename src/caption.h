@@ -53,13 +53,19 @@ static inline libcaption_stauts_t libcaption_status_update(libcaption_stauts_t o
 #define SCREEN_ROWS 15
 #define SCREEN_COLS 32
 
+// Cells hold an eia608_char_map index rather than the utf8 bytes, which are
+// only looked up when the frame is read
 typedef struct {
-    unsigned int uln : 1; //< underline
-    unsigned int sty : 3; //< style
-    utf8_char_t data[5]; //< 4 byte utf8 values plus null term
+    uint8_t chr; //< eia608_char_map index plus one, 0 is an empty cell
+    uint8_t uln : 1; //< underline
+    uint8_t sty : 3; //< style
 } caption_frame_cell_t;
 
+// Screen rows are addressed through row, so roll-up only rotates indexes. Clearing a
+// buffer only resets rows, a row is zeroed the first time it is written after a clear
 typedef struct {
+    uint16_t rows; //< bit per cell row holding cells written since the last clear
+    uint8_t row[SCREEN_ROWS]; //< cell row backing each screen row
     caption_frame_cell_t cell[SCREEN_ROWS][SCREEN_COLS];
 } caption_frame_buffer_t;
 
@@ -69,29 +75,58 @@ typedef struct {
     unsigned int rup : 2; //< roll-up line count minus 1
     int8_t row, col;
     uint16_t cc_data;
+    unsigned int chn : 2; //< data channel selected on this field by the last code with a channel bit, 2 for xds
 } caption_frame_state_t;
 
 // timestamp and duration are in seconds
+// front, back and write point into buffer, so a caption_frame_t must not be copied by value
 typedef struct {
     double timestamp;
     //xds_t xds;
     caption_frame_state_t state;
-    caption_frame_buffer_t front;
-    caption_frame_buffer_t back;
+    caption_frame_buffer_t buffer[2];
+    caption_frame_buffer_t* front; //< displayed memory
+    caption_frame_buffer_t* back; //< non-displayed memory, swapped with front on end of caption
     caption_frame_buffer_t* write;
+    uint16_t dirty; //< bit per screen row of front changed since it was last rendered
+    uint8_t channel; //< 0 - 3 for CC1 - CC4. cc_data for other channels on the same field is ignored
     libcaption_stauts_t status;
 } caption_frame_t;
 
+// CC1 and CC2 are carried on field 1, CC3 and CC4 on field 2
+#define CAPTION_CHANNELS 4
+static inline int caption_channel_field(int channel) { return (channel >> 1) & 1; }
+
+// Decodes every channel from the same cc_data, each into its own caption_frame_t
+struct dtvcc_t;
+typedef struct {
+    caption_frame_t frame[CAPTION_CHANNELS]; //< CC1, CC2, CC3, CC4
+    unsigned ready; //< bit per channel that became LIBCAPTION_READY during the last decode
+    unsigned error; //< bit per channel that failed during the last decode, only CC1 fails the whole decode
+    struct dtvcc_t* dtvcc; //< optional, set to also decode CEA-708 services (see dtvcc.h)
+} caption_channels_t;
+
 /*!
     \brief Initializes an allocated caption_frame_t instance
     \param frame Pointer to prealocated caption_frame_t object
 */
 void caption_frame_init(caption_frame_t* frame);
+/*!
+    \brief Initializes a caption_frame_t that decodes a channel other than CC1
+    \param frame Pointer to prealocated caption_frame_t object
+    \param channel 0 - 3 for CC1 - CC4
+*/
+void caption_frame_init_channel(caption_frame_t* frame, int channel);
+/*!
+    \brief Initializes all four channels of a caption_channels_t
+    \param channels Pointer to prealocated caption_channels_t object
+*/
+void caption_channels_init(caption_channels_t* channels);
 
 /*! \brief
     \param
 */
-static inline int caption_frame_painton(caption_frame_t* frame) { return (frame->write == &frame->front) ? 1 : 0; }
+static inline int caption_frame_painton(caption_frame_t* frame) { return (frame->write == frame->front) ? 1 : 0; }
 /*! \brief
     \param
 */
@@ -111,7 +146,7 @@ int caption_frame_write_char(caption_frame_t* frame, int row, int col, eia608_st
     \param
 */
 const utf8_char_t* caption_frame_read_char(caption_frame_t* frame, int row, int col, eia608_style_t* style, int* underline);
-/*! \brief
+/*! \brief Decodes one cc_data word from the frame's field. Words for the other channel on that field are ignored
     \param
 */
 libcaption_stauts_t caption_frame_decode(caption_frame_t* frame, uint16_t cc_data, double timestamp);
@@ -120,6 +155,20 @@ libcaption_stauts_t caption_frame_decode(caption_frame_t* frame, uint16_t cc_dat
 */
 #define CAPTION_FRAME_TEXT_BYTES (4 * ((SCREEN_COLS + 2) * SCREEN_ROWS) + 1)
 size_t caption_frame_to_text(caption_frame_t* frame, utf8_char_t* data);
+/*! \brief Returns a bit per screen row (row 0 is bit 0) that changed since it was last rendered
+    \param frame A pointer to an allocted and initialized caption_frame_t object
+
+    Live consumers can re-render only these rows with caption_frame_row_to_text instead
+    of rendering the whole screen on every LIBCAPTION_READY
+*/
+static inline uint16_t caption_frame_dirty_rows(caption_frame_t* frame) { return frame->dirty; }
+/*! \brief Renders a single screen row and marks it clean
+    \param frame A pointer to an allocted and initialized caption_frame_t object
+    \param row Screen row, must be between 0 and SCREEN_ROWS-1
+    \param data Output buffer of at least CAPTION_FRAME_ROW_TEXT_BYTES. Leading whitespace is dropped
+*/
+#define CAPTION_FRAME_ROW_TEXT_BYTES (4 * SCREEN_COLS + 1)
+size_t caption_frame_row_to_text(caption_frame_t* frame, int row, utf8_char_t* data);
 /*! \brief
     \param
 */
@@ -132,6 +132,51 @@ error:
 }
 
 
+// 47 41 39 34 03 C1 FF FC 94 20 : ATSC A/53 user_data() following user_data_start_code
+libcaption_stauts_t cea708_parse_h262(const uint8_t* data, size_t size, cea708_t* cea708)
+{
+    if (5 > size) {
+        goto error;
+    }
+
+    cea708->user_identifier = ((data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3]);
+    cea708->user_data_type_code = data[4];
+    data += 5, size -= 5;
+
+    if (GA94 == cea708->user_identifier && 3 == cea708->user_data_type_code && 2 <= size) {
+        cea708_parse_user_data_type_strcture(data, size, &cea708->user_data);
+    }
+
+    return LIBCAPTION_OK;
+error:
+    return LIBCAPTION_ERROR;
+}
+
+int cea708_add_cc_data(cea708_t* cea708, int valid, cea708_cc_type_t type, uint16_t cc_data)
+{
+    if (31 <= cea708->user_data.cc_count) {
+        return 0;
+    }
+
+    cea708->user_data.cc_data[cea708->user_data.cc_count].marker_bits = 0x1F;
+    cea708->user_data.cc_data[cea708->user_data.cc_count].cc_valid = valid;
+    cea708->user_data.cc_data[cea708->user_data.cc_count].cc_type = type;
+    cea708->user_data.cc_data[cea708->user_data.cc_count].cc_data = cc_data;
+    ++cea708->user_data.cc_count;
+    return 1;
+}
+
+int cea708_cat(cea708_t* to, cea708_t* from)
+{
+    int i, count = 0;
+
+    for (i = 0; i < (int)from->user_data.cc_count; ++i) {
+        cc_data_t* cc = &from->user_data.cc_data[i];
+        count += cea708_add_cc_data(to, cc->cc_valid, (cea708_cc_type_t)cc->cc_type, (uint16_t)cc->cc_data);
+    }
+
+    return count;
+}
 
 libcaption_stauts_t cea708_to_caption_frame(caption_frame_t* frame, cea708_t* cea708)
 {
@@ -146,8 +191,7 @@ libcaption_stauts_t cea708_to_caption_frame(caption_frame_t* frame, cea708_t* ce
             uint16_t cc_data      = cea708->user_data.cc_data[i].cc_data;
 
 
-            if (valid && cc_type_ntsc_cc_field_1 == type) {
-            	//printf("cea708_to_caption_frame() count:%d\n",i);
+            if (valid && (cea708_cc_type_t)caption_channel_field(frame->channel) == type) {
                 status = libcaption_status_update(status, caption_frame_decode(frame, cc_data, cea708->timestamp));
             }
         }
@@ -155,3 +199,52 @@ libcaption_stauts_t cea708_to_caption_frame(caption_frame_t* frame, cea708_t* ce
 
     return status;
 }
+
+libcaption_stauts_t cea708_to_caption_channels(caption_channels_t* channels, cea708_t* cea708)
+{
+    int i;
+    libcaption_stauts_t status = LIBCAPTION_OK;
+    channels->ready = 0;
+    channels->error = 0;
+
+    for (i = 0; i < CAPTION_CHANNELS; ++i) {
+        libcaption_stauts_t frame_status = cea708_to_caption_frame(&channels->frame[i], cea708);
+
+        if (LIBCAPTION_READY == frame_status) {
+            channels->ready |= 1 << i;
+        }
+
+        // A bad word on another channel shouldn't stop CC1, record it and carry on
+        if (LIBCAPTION_ERROR == frame_status) {
+            channels->error |= 1 << i;
+            frame_status = i ? LIBCAPTION_OK : LIBCAPTION_ERROR;
+        }
+
+        status = libcaption_status_update(status, frame_status);
+    }
+
+    if (channels->dtvcc) {
+        status = libcaption_status_update(status, cea708_to_dtvcc(channels->dtvcc, cea708));
+    }
+
+    return status;
+}
+
+libcaption_stauts_t cea708_to_dtvcc(dtvcc_t* dtvcc, cea708_t* cea708)
+{
+    int i, count = cea708->user_data.cc_count;
+    libcaption_stauts_t status = LIBCAPTION_OK;
+    dtvcc->ready = 0;
+
+    for (i = 0; i < count; ++i) {
+        int valid = cea708->user_data.cc_data[i].cc_valid;
+        cea708_cc_type_t type = cea708->user_data.cc_data[i].cc_type;
+        uint16_t cc_data = cea708->user_data.cc_data[i].cc_data;
+
+        if (valid && (cc_type_dtvcc_packet_start == type || cc_type_dtvcc_packet_data == type)) {
+            status = libcaption_status_update(status, dtvcc_decode(dtvcc, cc_type_dtvcc_packet_start == type, cc_data, cea708->timestamp));
+        }
+    }
+
+    return status;
+}
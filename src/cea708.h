@@ -28,6 +28,7 @@ extern "C" {
 #endif
 
 #include "caption.h"
+#include "dtvcc.h"
 #define CEA608_MAX_SIZE (255)
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -102,14 +103,28 @@ libcaption_stauts_t cea708_parse_h264(const uint8_t* data, size_t size, cea708_t
     \param
 */
 libcaption_stauts_t cea708_parse_h262(const uint8_t* data, size_t size, cea708_t* cea708);
-/*! \brief
+/*! \brief Decodes the cc_data for the frame's channel
     \param
 */
 libcaption_stauts_t cea708_to_caption_frame(caption_frame_t* frame, cea708_t* cea708);
+/*! \brief Decodes the cc_data for all four channels. channels->ready is set to the channels that became LIBCAPTION_READY
+        and channels->error to the ones that failed. Only a CC1 failure returns LIBCAPTION_ERROR
+    \param
+*/
+libcaption_stauts_t cea708_to_caption_channels(caption_channels_t* channels, cea708_t* cea708);
+/*! \brief Decodes the DTVCC triplets. dtvcc->ready is set to the services that became LIBCAPTION_READY
+    \param
+*/
+libcaption_stauts_t cea708_to_dtvcc(dtvcc_t* dtvcc, cea708_t* cea708);
 /*! \brief
     \param
 */
 int cea708_add_cc_data(cea708_t* cea708, int valid, cea708_cc_type_t type, uint16_t cc_data);
+/*! \brief
+        Appends the cc_data triplets of from to to. Returns the number appended
+    \param
+*/
+int cea708_cat(cea708_t* to, cea708_t* from);
 /*! \brief
     \param
 */
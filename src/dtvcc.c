@@ -0,0 +1,585 @@
+/**********************************************************************************************/
+/* The MIT License                                                                            */
+/*                                                                                            */
+/* Copyright 2016-2017 Twitch Interactive, Inc. or its affiliates. All Rights Reserved.       */
+/*                                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy               */
+/* of this software and associated documentation files (the "Software"), to deal              */
+/* in the Software without restriction, including without limitation the rights               */
+/* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell                  */
+/* copies of the Software, and to permit persons to whom the Software is                      */
+/* furnished to do so, subject to the following conditions:                                   */
+/*                                                                                            */
+/* The above copyright notice and this permission notice shall be included in                 */
+/* all copies or substantial portions of the Software.                                        */
+/*                                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR                 */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,                   */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE                */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER                     */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,              */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN                  */
+/* THE SOFTWARE.                                                                              */
+/**********************************************************************************************/
+#include "dtvcc.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Code sets
+#define DTVCC_EXT1 0x10
+#define DTVCC_P16 0x18
+#define DTVCC_UNSUPPORTED '_'
+
+// G2, 0x20 - 0x7F. Unassigned codes are shown as an underscore
+static const uint16_t _dtvcc_g2[96] = {
+    0x0020, 0x00A0, '_', '_', '_', 0x2026, '_', '_', '_', '_', 0x0160, '_', 0x0152, '_', '_', '_',
+    0x2588, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, '_', '_', '_', 0x2122, 0x0161, '_', 0x0153, 0x2120, '_', 0x0178,
+    '_', '_', '_', '_', '_', '_', '_', '_', '_', '_', '_', '_', '_', '_', '_', '_',
+    '_', '_', '_', '_', '_', '_', '_', '_', '_', '_', '_', '_', '_', '_', '_', '_',
+    '_', '_', '_', '_', '_', '_', '_', '_', '_', '_', '_', '_', '_', '_', '_', '_',
+    '_', '_', '_', '_', '_', '_', 0x215B, 0x215C, 0x215D, 0x215E, 0x2502, 0x2510, 0x2514, 0x2500, 0x2518, 0x250C,
+};
+
+// Parameter bytes following each C1 command, 0x80 - 0x9F
+static const uint8_t _dtvcc_c1_size[32] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 0, 0,
+    2, 3, 2, 0, 0, 0, 0, 4, 6, 6, 6, 6, 6, 6, 6, 6,
+};
+
+typedef enum {
+    dtvcc_c0_etx = 0x03,
+    dtvcc_c0_bs = 0x08,
+    dtvcc_c0_ff = 0x0C,
+    dtvcc_c0_cr = 0x0D,
+    dtvcc_c0_hcr = 0x0E,
+    dtvcc_c1_cw0 = 0x80,
+    dtvcc_c1_clw = 0x88,
+    dtvcc_c1_dsw = 0x89,
+    dtvcc_c1_hdw = 0x8A,
+    dtvcc_c1_tgw = 0x8B,
+    dtvcc_c1_dlw = 0x8C,
+    dtvcc_c1_dly = 0x8D,
+    dtvcc_c1_dlc = 0x8E,
+    dtvcc_c1_rst = 0x8F,
+    dtvcc_c1_spa = 0x90,
+    dtvcc_c1_spc = 0x91,
+    dtvcc_c1_spl = 0x92,
+    dtvcc_c1_swa = 0x97,
+    dtvcc_c1_df0 = 0x98,
+} dtvcc_command_t;
+
+////////////////////////////////////////////////////////////////////////////////
+// Windows
+static void _dtvcc_window_clear(dtvcc_window_t* window)
+{
+    memset(&window->cell[0][0], 0, sizeof(window->cell));
+}
+
+static void _dtvcc_service_reset(dtvcc_service_t* service)
+{
+    memset(&service->window[0], 0, sizeof(service->window));
+    service->current = -1;
+}
+
+// Marks the service ready when a change is on screen
+static void _dtvcc_window_changed(dtvcc_service_t* service, dtvcc_window_t* window)
+{
+    if (window->defined && window->visible) {
+        service->status = LIBCAPTION_READY;
+    }
+}
+
+static dtvcc_window_t* _dtvcc_current_window(dtvcc_service_t* service)
+{
+    if (0 > service->current || !service->window[service->current].defined) {
+        return 0;
+    }
+
+    return &service->window[service->current];
+}
+
+static void _dtvcc_write_char(dtvcc_service_t* service, uint16_t chr)
+{
+    dtvcc_window_t* window = _dtvcc_current_window(service);
+
+    // No word wrap, text past the window's last column is clipped
+    if (!window || window->row_count <= window->row || window->col_count <= window->col) {
+        return;
+    }
+
+    dtvcc_cell_t* cell = &window->cell[window->row][window->col++];
+    cell->chr = chr;
+    cell->uln = window->uln;
+    cell->ita = window->ita;
+    _dtvcc_window_changed(service, window);
+}
+
+static void _dtvcc_carriage_return(dtvcc_service_t* service)
+{
+    dtvcc_window_t* window = _dtvcc_current_window(service);
+
+    if (!window) {
+        return;
+    }
+
+    window->col = 0;
+
+    if (window->row + 1 < window->row_count) {
+        ++window->row;
+        return;
+    }
+
+    // Scroll the window up a row, the pen stays on the new bottom row
+    window->row = window->row_count - 1;
+    memmove(&window->cell[0][0], &window->cell[1][0], sizeof(window->cell[0]) * window->row);
+    memset(&window->cell[window->row][0], 0, sizeof(window->cell[0]));
+    _dtvcc_window_changed(service, window);
+}
+
+static void _dtvcc_define_window(dtvcc_service_t* service, int id, const uint8_t* param)
+{
+    dtvcc_window_t* window = &service->window[id];
+
+    // Redefining an existing window only updates its attributes
+    if (!window->defined) {
+        _dtvcc_window_clear(window);
+        window->row = window->col = 0;
+        window->uln = window->ita = 0;
+    }
+
+    window->defined = 1;
+    window->visible = (param[0] >> 5) & 0x01;
+    window->row_lock = (param[0] >> 4) & 0x01;
+    window->col_lock = (param[0] >> 3) & 0x01;
+    window->priority = param[0] & 0x07;
+    window->relative = (param[1] >> 7) & 0x01;
+    window->anchor_vertical = param[1] & 0x7F;
+    window->anchor_horizontal = param[2];
+    window->anchor_point = (param[3] >> 4) & 0x0F;
+    window->row_count = (param[3] & 0x0F) + 1;
+    window->col_count = (param[4] & 0x3F) + 1;
+    window->window_style = (param[5] >> 3) & 0x07;
+    window->pen_style = param[5] & 0x07;
+
+    if (DTVCC_MAX_ROWS < window->row_count) {
+        window->row_count = DTVCC_MAX_ROWS;
+    }
+
+    if (DTVCC_MAX_COLS < window->col_count) {
+        window->col_count = DTVCC_MAX_COLS;
+    }
+
+    // Keep the pen inside a window that was redefined smaller
+    if (window->row_count <= window->row) {
+        window->row = window->row_count - 1;
+    }
+
+    if (window->col_count < window->col) {
+        window->col = window->col_count;
+    }
+
+    service->current = id;
+    _dtvcc_window_changed(service, window);
+}
+
+// Applies a window command to each window set in bitmap
+static void _dtvcc_window_command(dtvcc_service_t* service, dtvcc_command_t cmd, uint8_t bitmap)
+{
+    int i;
+    for (i = 0; i < DTVCC_MAX_WINDOWS; ++i) {
+        dtvcc_window_t* window = &service->window[i];
+
+        if (!(bitmap & (1 << i)) || !window->defined) {
+            continue;
+        }
+
+        switch (cmd) {
+        case dtvcc_c1_clw:
+            _dtvcc_window_clear(window);
+            _dtvcc_window_changed(service, window);
+            break;
+
+        case dtvcc_c1_dsw:
+            window->visible = 1;
+            _dtvcc_window_changed(service, window);
+            break;
+
+        case dtvcc_c1_hdw:
+            _dtvcc_window_changed(service, window);
+            window->visible = 0;
+            break;
+
+        case dtvcc_c1_tgw:
+            _dtvcc_window_changed(service, window);
+            window->visible = !window->visible;
+            _dtvcc_window_changed(service, window);
+            break;
+
+        case dtvcc_c1_dlw:
+            _dtvcc_window_changed(service, window);
+            window->defined = window->visible = 0;
+            service->current = (i == service->current) ? -1 : service->current;
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Service blocks. Commands never span blocks, so a truncated command ends the block
+static size_t _dtvcc_decode_ext1(dtvcc_service_t* service, const uint8_t* data, size_t size)
+{
+    size_t need;
+    uint8_t c = data[0];
+
+    if (0x20 > c) {
+        need = 1 + (c >> 3); // C2, 0 - 3 parameter bytes
+    } else if (0x80 > c) {
+        _dtvcc_write_char(service, _dtvcc_g2[c - 0x20]);
+        return 1;
+    } else if (0x90 > c) {
+        need = 1 + (0x88 > c ? 4 : 5); // C3
+    } else if (0xA0 > c) {
+        need = 2 + (2 <= size ? (data[1] & 0x3F) : 0); // C3 variable length
+    } else {
+        _dtvcc_write_char(service, DTVCC_UNSUPPORTED); // G3, the [CC] icon has no unicode equivalent
+        return 1;
+    }
+
+    return need <= size ? need : size;
+}
+
+static size_t _dtvcc_decode_c1(dtvcc_service_t* service, const uint8_t* data, size_t size)
+{
+    dtvcc_command_t cmd = (dtvcc_command_t)data[0];
+    size_t need = 1 + _dtvcc_c1_size[cmd - 0x80];
+    dtvcc_window_t* window;
+
+    if (size < need) {
+        return size;
+    }
+
+    if (dtvcc_c1_df0 <= cmd) {
+        _dtvcc_define_window(service, cmd - dtvcc_c1_df0, &data[1]);
+        return need;
+    }
+
+    if (dtvcc_c1_clw > cmd) {
+        if (service->window[cmd - dtvcc_c1_cw0].defined) {
+            service->current = cmd - dtvcc_c1_cw0;
+        }
+
+        return need;
+    }
+
+    switch (cmd) {
+    case dtvcc_c1_clw:
+    case dtvcc_c1_dsw:
+    case dtvcc_c1_hdw:
+    case dtvcc_c1_tgw:
+    case dtvcc_c1_dlw:
+        _dtvcc_window_command(service, cmd, data[1]);
+        break;
+
+    case dtvcc_c1_rst:
+        _dtvcc_window_command(service, dtvcc_c1_dlw, 0xFF);
+        _dtvcc_service_reset(service);
+        break;
+
+    case dtvcc_c1_spa:
+        if ((window = _dtvcc_current_window(service))) {
+            window->ita = (data[2] >> 7) & 0x01;
+            window->uln = (data[2] >> 6) & 0x01;
+        }
+        break;
+
+    case dtvcc_c1_spl:
+        if ((window = _dtvcc_current_window(service))) {
+            window->row = window->row_count > (data[1] & 0x0F) ? (data[1] & 0x0F) : window->row_count - 1;
+            window->col = window->col_count > (data[2] & 0x3F) ? (data[2] & 0x3F) : window->col_count - 1;
+        }
+        break;
+
+    // Delays, colors, window attributes and reserved codes do not affect the text
+    default:
+        LIBCAPTION_TRACE(CAPTION, DEBUG, "dtvcc ignored command 0x%02X\n", cmd);
+        break;
+    }
+
+    return need;
+}
+
+static size_t _dtvcc_decode_c0(dtvcc_service_t* service, const uint8_t* data, size_t size)
+{
+    dtvcc_window_t* window = _dtvcc_current_window(service);
+    uint8_t c = data[0];
+
+    if (DTVCC_EXT1 == c) {
+        return 1 < size ? 1 + _dtvcc_decode_ext1(service, &data[1], size - 1) : size;
+    }
+
+    if (DTVCC_P16 == c) {
+        if (3 <= size) {
+            _dtvcc_write_char(service, (uint16_t)((data[1] << 8) | data[2]));
+        }
+
+        return 3 <= size ? 3 : size;
+    }
+
+    if (0x10 < c) {
+        size_t need = 0x18 > c ? 2 : 3;
+        return need <= size ? need : size;
+    }
+
+    switch (c) {
+    case dtvcc_c0_cr:
+        _dtvcc_carriage_return(service);
+        break;
+
+    case dtvcc_c0_hcr:
+        if (window) {
+            window->col = 0;
+            memset(&window->cell[window->row][0], 0, sizeof(window->cell[0]));
+            _dtvcc_window_changed(service, window);
+        }
+        break;
+
+    case dtvcc_c0_ff:
+        if (window) {
+            _dtvcc_window_clear(window);
+            window->row = window->col = 0;
+            _dtvcc_window_changed(service, window);
+        }
+        break;
+
+    case dtvcc_c0_bs:
+        if (window && 0 < window->col) {
+            --window->col;
+            memset(&window->cell[window->row][window->col], 0, sizeof(dtvcc_cell_t));
+            _dtvcc_window_changed(service, window);
+        }
+        break;
+
+    default: // NUL, ETX and reserved codes
+        break;
+    }
+
+    return 1;
+}
+
+static void _dtvcc_decode_block(dtvcc_service_t* service, const uint8_t* data, size_t size, double timestamp)
+{
+    size_t used;
+
+    if (0 > service->timestamp || LIBCAPTION_READY == service->status) {
+        service->timestamp = timestamp;
+        service->status = LIBCAPTION_OK;
+    }
+
+    for (; size; data += used, size -= used) {
+        uint8_t c = data[0];
+
+        if (0x20 > c) {
+            used = _dtvcc_decode_c0(service, data, size);
+        } else if (0x80 > c) {
+            _dtvcc_write_char(service, 0x7F == c ? 0x266A : c); // G0, 0x7F is a music note
+            used = 1;
+        } else if (0xA0 > c) {
+            used = _dtvcc_decode_c1(service, data, size);
+        } else {
+            _dtvcc_write_char(service, c); // G1 is latin-1
+            used = 1;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Packets
+static dtvcc_service_t* _dtvcc_service_alloc(dtvcc_t* dtvcc, int id)
+{
+    if (!dtvcc->service[id]) {
+        dtvcc_service_t* service = (dtvcc_service_t*)malloc(sizeof(dtvcc_service_t));
+
+        if (!service) {
+            return 0;
+        }
+
+        service->timestamp = -1;
+        service->status = LIBCAPTION_OK;
+        _dtvcc_service_reset(service);
+        dtvcc->service[id] = service;
+    }
+
+    return dtvcc->service[id];
+}
+
+static libcaption_stauts_t _dtvcc_parse_packet(dtvcc_t* dtvcc)
+{
+    // First byte is the packet header, service blocks follow until a null block
+    const uint8_t* data = &dtvcc->packet[1];
+    size_t size = dtvcc->size - 1;
+    libcaption_stauts_t status = LIBCAPTION_OK;
+
+    while (size) {
+        int id = data[0] >> 5;
+        size_t block = data[0] & 0x1F;
+        ++data, --size;
+
+        if (0 == id) {
+            break;
+        }
+
+        if (7 == id) {
+            if (!size) {
+                break;
+            }
+
+            // Extended service numbers 0 - 6 are reserved, skip the block rather than decode it as 1 - 6
+            id = 7 <= (data[0] & 0x3F) ? (data[0] & 0x3F) : 0;
+            ++data, --size;
+        }
+
+        block = block < size ? block : size;
+
+        if (id && block) {
+            dtvcc_service_t* service = _dtvcc_service_alloc(dtvcc, id);
+
+            if (!service) {
+                status = LIBCAPTION_ERROR;
+                break;
+            }
+
+            _dtvcc_decode_block(service, data, block, dtvcc->timestamp);
+
+            if (LIBCAPTION_READY == service->status) {
+                dtvcc->ready |= (uint64_t)1 << id;
+                status = libcaption_status_update(status, LIBCAPTION_READY);
+            }
+        }
+
+        data += block, size -= block;
+    }
+
+    dtvcc->size = dtvcc->packet_size = 0;
+    return status;
+}
+
+void dtvcc_init(dtvcc_t* dtvcc)
+{
+    memset(dtvcc, 0, sizeof(dtvcc_t));
+}
+
+void dtvcc_free(dtvcc_t* dtvcc)
+{
+    int i;
+    for (i = 0; i < DTVCC_MAX_SERVICES; ++i) {
+        free(dtvcc->service[i]);
+    }
+
+    dtvcc_init(dtvcc);
+}
+
+libcaption_stauts_t dtvcc_decode(dtvcc_t* dtvcc, int start, uint16_t cc_data, double timestamp)
+{
+    libcaption_stauts_t status = LIBCAPTION_OK;
+
+    if (start) {
+        // A packet cut short by the next start is decoded as far as it got
+        if (dtvcc->packet_size) {
+            status = _dtvcc_parse_packet(dtvcc);
+        }
+
+        dtvcc->packet_size = (cc_data & 0x3F00) ? ((cc_data >> 8) & 0x3F) * 2 : DTVCC_PACKET_SIZE;
+        dtvcc->timestamp = timestamp;
+    } else if (!dtvcc->packet_size) {
+        return status;
+    }
+
+    dtvcc->packet[dtvcc->size++] = (uint8_t)(cc_data >> 8);
+    dtvcc->packet[dtvcc->size++] = (uint8_t)(cc_data >> 0);
+
+    if (dtvcc->packet_size <= dtvcc->size) {
+        status = libcaption_status_update(status, _dtvcc_parse_packet(dtvcc));
+    }
+
+    return status;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static size_t _dtvcc_utf8(uint16_t chr, utf8_char_t* data)
+{
+    if (0x80 > chr) {
+        data[0] = (utf8_char_t)chr;
+        return 1;
+    }
+
+    if (0x800 > chr) {
+        data[0] = (utf8_char_t)(0xC0 | (chr >> 6));
+        data[1] = (utf8_char_t)(0x80 | (chr & 0x3F));
+        return 2;
+    }
+
+    data[0] = (utf8_char_t)(0xE0 | (chr >> 12));
+    data[1] = (utf8_char_t)(0x80 | ((chr >> 6) & 0x3F));
+    data[2] = (utf8_char_t)(0x80 | (chr & 0x3F));
+    return 3;
+}
+
+size_t dtvcc_window_to_text(const dtvcc_window_t* window, utf8_char_t* data)
+{
+    int r, c, count;
+    size_t size = 0;
+
+    for (r = 0; r < window->row_count; ++r) {
+        for (c = 0, count = 0; c < window->col_count; ++c) {
+            uint16_t chr = window->cell[r][c].chr;
+
+            // dont start a new line until we encounter at least one printable character
+            if (!chr || (0 == count && (0x20 >= chr || 0xA0 == chr))) {
+                continue;
+            }
+
+            if (0 == count++ && 0 < size) {
+                data[size++] = '\n';
+            }
+
+            size += _dtvcc_utf8(chr, &data[size]);
+        }
+    }
+
+    data[size] = '\0';
+    return size;
+}
+
+size_t dtvcc_service_to_text(const dtvcc_service_t* service, utf8_char_t* data)
+{
+    int i, priority;
+    size_t s, size = 0;
+    (*data) = '\0';
+
+    for (priority = 0; priority < DTVCC_MAX_WINDOWS; ++priority) {
+        for (i = 0; i < DTVCC_MAX_WINDOWS; ++i) {
+            const dtvcc_window_t* window = &service->window[i];
+
+            if (!window->defined || !window->visible || priority != window->priority) {
+                continue;
+            }
+
+            if (0 < (s = dtvcc_window_to_text(window, &data[size ? size + 1 : 0]))) {
+                if (size) {
+                    data[size++] = '\n';
+                }
+
+                size += s;
+            } else {
+                data[size] = '\0';
+            }
+        }
+    }
+
+    return size;
+}
@@ -0,0 +1,119 @@
+/**********************************************************************************************/
+/* The MIT License                                                                            */
+/*                                                                                            */
+/* Copyright 2016-2017 Twitch Interactive, Inc. or its affiliates. All Rights Reserved.       */
+/*                                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy               */
+/* of this software and associated documentation files (the "Software"), to deal              */
+/* in the Software without restriction, including without limitation the rights               */
+/* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell                  */
+/* copies of the Software, and to permit persons to whom the Software is                      */
+/* furnished to do so, subject to the following conditions:                                   */
+/*                                                                                            */
+/* The above copyright notice and this permission notice shall be included in                 */
+/* all copies or substantial portions of the Software.                                        */
+/*                                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR                 */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,                   */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE                */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER                     */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,              */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN                  */
+/* THE SOFTWARE.                                                                              */
+/**********************************************************************************************/
+#ifndef LIBCAPTION_DTVCC_H
+#define LIBCAPTION_DTVCC_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "caption.h"
+////////////////////////////////////////////////////////////////////////////////
+// CEA-708 digital television closed captions (DTVCC). Caption channel packets are
+// reassembled from cc_data, split into service blocks and decoded per service into
+// up to eight windows using the 708 window and pen model.
+#define DTVCC_PACKET_SIZE 128
+#define DTVCC_MAX_SERVICES 64 //< services 1 - 63
+#define DTVCC_MAX_WINDOWS 8
+#define DTVCC_MAX_ROWS 15
+#define DTVCC_MAX_COLS 42
+
+typedef struct {
+    uint16_t chr; //< unicode code point, 0 is an empty cell
+    uint8_t uln : 1; //< underline
+    uint8_t ita : 1; //< italics
+} dtvcc_cell_t;
+
+typedef struct {
+    unsigned int defined : 1;
+    unsigned int visible : 1;
+    unsigned int row_lock : 1;
+    unsigned int col_lock : 1;
+    unsigned int relative : 1; //< anchor is a percentage rather than a grid position
+    unsigned int priority : 3; //< 0 is the highest
+    unsigned int anchor_point : 4; //< 0 - 8, which point of the window the anchor refers to
+    unsigned int uln : 1; //< pen underline
+    unsigned int ita : 1; //< pen italics
+    uint8_t anchor_vertical;
+    uint8_t anchor_horizontal;
+    uint8_t row_count; //< 1 - 15
+    uint8_t col_count; //< 1 - 42
+    uint8_t window_style;
+    uint8_t pen_style;
+    int8_t row, col; //< pen location
+    dtvcc_cell_t cell[DTVCC_MAX_ROWS][DTVCC_MAX_COLS];
+} dtvcc_window_t;
+
+// timestamp is in seconds
+typedef struct {
+    double timestamp;
+    int current; //< current window, -1 until one is defined
+    dtvcc_window_t window[DTVCC_MAX_WINDOWS];
+    libcaption_stauts_t status;
+} dtvcc_service_t;
+
+typedef struct dtvcc_t {
+    uint8_t packet[DTVCC_PACKET_SIZE];
+    size_t size; //< bytes of packet received
+    size_t packet_size; //< expected packet size, 0 while waiting for a packet start
+    double timestamp; //< of the packet start
+    uint64_t ready; //< bit per service that became LIBCAPTION_READY during the last decode
+    dtvcc_service_t* service[DTVCC_MAX_SERVICES]; //< allocated when a service is first seen
+} dtvcc_t;
+
+/*! \brief
+    \param
+*/
+void dtvcc_init(dtvcc_t* dtvcc);
+/*! \brief Releases all services. dtvcc may be reused after calling dtvcc_init
+    \param
+*/
+void dtvcc_free(dtvcc_t* dtvcc);
+/*! \brief Decodes one cc_data word from a DTVCC triplet
+    \param dtvcc
+    \param start Non zero for cc_type_dtvcc_packet_start, zero for cc_type_dtvcc_packet_data
+    \param cc_data
+    \param timestamp
+*/
+libcaption_stauts_t dtvcc_decode(dtvcc_t* dtvcc, int start, uint16_t cc_data, double timestamp);
+/*! \brief Returns a decoded service, or NULL if nothing has been received for it
+    \param
+*/
+static inline dtvcc_service_t* dtvcc_service(dtvcc_t* dtvcc, int service) { return (0 < service && DTVCC_MAX_SERVICES > service) ? dtvcc->service[service] : 0; }
+/*! \brief Renders one window, leading whitespace on each row is dropped
+    \param window
+    \param data Output buffer of at least DTVCC_WINDOW_TEXT_BYTES
+*/
+#define DTVCC_WINDOW_TEXT_BYTES (DTVCC_MAX_ROWS * (3 * DTVCC_MAX_COLS + 1) + 1)
+size_t dtvcc_window_to_text(const dtvcc_window_t* window, utf8_char_t* data);
+/*! \brief Renders the visible windows of a service, highest priority first
+    \param service
+    \param data Output buffer of at least DTVCC_SERVICE_TEXT_BYTES
+*/
+#define DTVCC_SERVICE_TEXT_BYTES (DTVCC_MAX_WINDOWS * DTVCC_WINDOW_TEXT_BYTES)
+size_t dtvcc_service_to_text(const dtvcc_service_t* service, utf8_char_t* data);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
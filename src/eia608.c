@@ -40,6 +40,30 @@ const char* eia608_style_map[] = {
     "italics",
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// cc_data classification tables, built from the masks in eia608.h
+#define EIA608_CP(B) ((uint8_t)(B) == (uint8_t)(EIA608_BP(B)) ? 0x80 : 0x00)
+#define EIA608_CH(B) (EIA608_CP(B)                                                                 \
+    | (0x00 == (0x7F & (B)) ? eia608_class_padding : 0)                                           \
+    | (0x14 == (0x76 & (B)) || 0x17 == (0x77 & (B)) ? eia608_class_control : 0)                   \
+    | (0x00 != (0x60 & (B)) ? eia608_class_basicna : 0)                                           \
+    | (0x11 == (0x77 & (B)) ? eia608_class_specialna | eia608_class_midrowchange : 0)             \
+    | (0x12 == (0x76 & (B)) ? eia608_class_westeu : 0)                                            \
+    | (0x10 == (0x70 & (B)) ? eia608_class_preamble : 0))
+#define EIA608_CL(B) (EIA608_CP(B)                                                                 \
+    | (0x00 == (0x7F & (B)) ? eia608_class_padding : 0)                                           \
+    | (0x20 == (0x70 & (B)) ? eia608_class_control | eia608_class_midrowchange : 0)               \
+    | eia608_class_basicna                                                                         \
+    | (0x30 == (0x70 & (B)) ? eia608_class_specialna : 0)                                         \
+    | (0x20 == (0x60 & (B)) ? eia608_class_westeu : 0)                                            \
+    | (0x40 == (0x40 & (B)) ? eia608_class_preamble : 0))
+#define EIA608_C2(T, B) T((B) + 0), T((B) + 1), T((B) + 2), T((B) + 3), T((B) + 4), T((B) + 5), T((B) + 6), T((B) + 7)
+#define EIA608_C1(T, B) EIA608_C2(T, (B) + 0), EIA608_C2(T, (B) + 8), EIA608_C2(T, (B) + 16), EIA608_C2(T, (B) + 24), EIA608_C2(T, (B) + 32), EIA608_C2(T, (B) + 40), EIA608_C2(T, (B) + 48), EIA608_C2(T, (B) + 56)
+#define EIA608_C0(T) EIA608_C1(T, 0), EIA608_C1(T, 64), EIA608_C1(T, 128), EIA608_C1(T, 192)
+
+const uint8_t eia608_class_table_hi[256] = { EIA608_C0(EIA608_CH) };
+const uint8_t eia608_class_table_lo[256] = { EIA608_C0(EIA608_CL) };
+////////////////////////////////////////////////////////////////////////////////
 static inline uint16_t eia608_row_pramble(int row, int chan, int x, int underline)
 {
     row = eia608_reverse_row_map[row & 0x0F];
@@ -105,7 +129,7 @@ uint16_t eia608_control_command(eia608_control_t cmd, int cc)
 ////////////////////////////////////////////////////////////////////////////////
 // text
 
-static int eia608_to_index(uint16_t cc_data, int* chan, int* c1, int* c2)
+int eia608_to_index(uint16_t cc_data, int* chan, int* c1, int* c2)
 {
     (*c1) = (*c2) = -1;
     (*chan) = 0;
@@ -109,6 +109,32 @@ static inline int eia608_is_norpak(uint16_t cc_data) { return 0x1724 == (0x777C
 */
 static inline int eia608_is_padding(uint16_t cc_data) { return 0x8080 == cc_data; }
 
+// The classes are mutually exclusive, each type above is the conjunction of a test on
+// the high byte and a test on the low byte. eia608_classify looks both up in a per byte
+// table and ANDs them. Bit 0x80 is only set when both bytes have valid parity
+typedef enum {
+    eia608_class_none = 0x00, //< valid parity, but nothing the decoder acts on (xds etc)
+    eia608_class_padding = 0x01,
+    eia608_class_control = 0x02,
+    eia608_class_basicna = 0x04,
+    eia608_class_specialna = 0x08,
+    eia608_class_westeu = 0x10,
+    eia608_class_preamble = 0x20,
+    eia608_class_midrowchange = 0x40,
+    eia608_class_invalid = 0x80, //< parity error
+} eia608_class_t;
+
+extern const uint8_t eia608_class_table_hi[256];
+extern const uint8_t eia608_class_table_lo[256];
+/*! \brief Classifies cc_data with two table lookups
+    \param cc_data Raw cc_data including parity bits
+*/
+static inline eia608_class_t eia608_classify(uint16_t cc_data)
+{
+    uint8_t c = eia608_class_table_hi[cc_data >> 8] & eia608_class_table_lo[cc_data & 0xFF];
+    return (0x80 & c) ? (eia608_class_t)(0x7F & c) : eia608_class_invalid;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // preamble
 typedef enum {
@@ -196,6 +222,14 @@ uint16_t eia608_from_basicna(uint16_t bna1, uint16_t bna2);
     \param
 */
 int eia608_to_utf8(uint16_t c, int* chan, utf8_char_t* char1, utf8_char_t* char2);
+/*! \brief Decodes the charcters in cc_data to eia608_char_map indexes
+    \param cc_data Charcter cc_data, parity bits are ignored
+    \param chan Set to the second channel bit, where the charcter set has one
+    \param c1 Index of the first charcter, or -1
+    \param c2 Index of the second charcter, or -1
+    \return Number of charcters decoded
+*/
+int eia608_to_index(uint16_t cc_data, int* chan, int* c1, int* c2);
 ////////////////////////////////////////////////////////////////////////////////
 /*! \brief
     \param
@@ -23,6 +23,7 @@
 /**********************************************************************************************/
 
 #include "mpeg.h"
+#include "trace.h"
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -30,32 +31,91 @@
 ////////////////////////////////////////////////////////////////////////////////
 // AVC RBSP Methods
 //  TODO move the to a avcutils file
-static size_t _find_emulation_prevention_byte(const uint8_t* data, size_t size)
+#if defined(__GNUC__)
+#define _mpeg_ctz(x) __builtin_ctz(x)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+static inline unsigned _mpeg_ctz(unsigned long x)
 {
-    size_t offset = 2;
-
-    while (offset < size) {
-        if (0 == data[offset]) {
-            // 0 0 X 3 //; we know X is zero
-            offset += 1;
-        } else if (3 != data[offset]) {
-            // 0 0 X 0 0 3; we know X is not 0 and not 3
-            offset += 3;
-        } else if (0 != data[offset - 1]) {
-            // 0 X 0 0 3
-            offset += 2;
-        } else if (0 != data[offset - 2]) {
-            // X 0 0 3
-            offset += 1;
-        } else {
-            // 0 0 3
-            return offset;
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (unsigned)i;
+}
+#endif
+
+#if defined(__AVX2__) && defined(_mpeg_ctz)
+#include <immintrin.h>
+#define MPEG_SIMD_AVX2
+#elif (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && 2 <= _M_IX86_FP)) && defined(_mpeg_ctz)
+#include <emmintrin.h>
+#define MPEG_SIMD_SSE2
+#endif
+
+// Returns the offset of the first 00 00 xx at or after from, or size if there is none.
+// The three byte pattern must fit entirely before size.
+// Used for both start codes (00 00 01) and emulation prevention (00 00 03)
+static size_t _find_zero_zero(const uint8_t* data, size_t size, size_t from, uint8_t xx)
+{
+    size_t i = from;
+
+#if defined(MPEG_SIMD_AVX2)
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i third = _mm256_set1_epi8((char)xx);
+
+    for (; i + 66 <= size; i += 64) {
+        __m256i lo = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)&data[i + 2]), third),
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)&data[i + 0]), zero),
+                _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)&data[i + 1]), zero)));
+        __m256i hi = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)&data[i + 34]), third),
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)&data[i + 32]), zero),
+                _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)&data[i + 33]), zero)));
+        unsigned mlo = (unsigned)_mm256_movemask_epi8(lo);
+        unsigned mhi = (unsigned)_mm256_movemask_epi8(hi);
+
+        if (mlo) {
+            return i + _mpeg_ctz(mlo);
+        }
+
+        if (mhi) {
+            return i + 32 + _mpeg_ctz(mhi);
+        }
+    }
+#elif defined(MPEG_SIMD_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i third = _mm_set1_epi8((char)xx);
+
+    for (; i + 34 <= size; i += 32) {
+        __m128i lo = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&data[i + 2]), third),
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&data[i + 0]), zero),
+                _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&data[i + 1]), zero)));
+        __m128i hi = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&data[i + 18]), third),
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&data[i + 16]), zero),
+                _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&data[i + 17]), zero)));
+        unsigned m = (unsigned)_mm_movemask_epi8(lo) | ((unsigned)_mm_movemask_epi8(hi) << 16);
+
+        if (m) {
+            return i + _mpeg_ctz(m);
+        }
+    }
+#endif
+
+    // Scalar tail (and fallback). Most bytes are not xx, so test that first
+    for (; i + 3 <= size; ++i) {
+        if (xx == data[i + 2] && 0x00 == data[i + 1] && 0x00 == data[i]) {
+            return i;
         }
     }
 
     return size;
 }
 
+static size_t _find_emulation_prevention_byte(const uint8_t* data, size_t size)
+{
+    size_t offset = _find_zero_zero(data, size, 0, 0x03);
+    return offset < size ? offset + 2 : size;
+}
+
+// Returns the number of source bytes holding destSize RBSP bytes. destData may be NULL to only skip them
 static size_t _copy_to_rbsp(uint8_t* destData, size_t destSize, const uint8_t* sorcData, size_t sorcSize)
 {
     size_t toCopy, totlSize = 0;
@@ -68,9 +128,12 @@ static size_t _copy_to_rbsp(uint8_t* destData, size_t destSize, const uint8_t* s
         // The following line IS correct! We want to look in sorcData up to destSize bytes
         // We know destSize is smaller than sorcSize because of the previous line
         toCopy = _find_emulation_prevention_byte(sorcData, destSize);
-        memcpy(destData, sorcData, toCopy);
+        if (destData) {
+            memcpy(destData, sorcData, toCopy);
+            destData += toCopy;
+        }
+
         totlSize += toCopy;
-        destData += toCopy;
         destSize -= toCopy;
 
         if (0 == destSize) {
@@ -89,10 +152,396 @@ static size_t _copy_to_rbsp(uint8_t* destData, size_t destSize, const uint8_t* s
 
 
 
+////////////////////////////////////////////////////////////////////////////////
+// Sequence parameter sets. Only parsed far enough to learn how many frames the
+// decoder may need to reorder, which bounds how long captions are held back
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+    unsigned zeros;
+    unsigned bits;
+    uint8_t byte;
+    int error;
+} _rbsp_reader_t;
+
+// Reads bits directly from the escaped NALU, dropping emulation prevention bytes on the fly
+static unsigned _rbsp_u1(_rbsp_reader_t* r)
+{
+    if (!r->bits) {
+        if (r->pos >= r->size) {
+            r->error = 1;
+            return 0;
+        }
+
+        r->byte = r->data[r->pos++];
+
+        if (2 <= r->zeros && 0x03 == r->byte) {
+            r->zeros = 0;
+            return _rbsp_u1(r);
+        }
+
+        r->zeros = r->byte ? 0 : r->zeros + 1;
+        r->bits = 8;
+    }
+
+    return (r->byte >> --r->bits) & 0x01;
+}
+
+static uint32_t _rbsp_u(_rbsp_reader_t* r, int bits)
+{
+    uint32_t val = 0;
+
+    while (0 < bits--) {
+        val = (val << 1) | _rbsp_u1(r);
+    }
+
+    return val;
+}
+
+static uint32_t _rbsp_ue(_rbsp_reader_t* r)
+{
+    int zeros = 0;
+
+    while (!r->error && !_rbsp_u1(r)) {
+        if (31 < ++zeros) {
+            r->error = 1;
+            return 0;
+        }
+    }
+
+    return (uint32_t)((1ull << zeros) - 1 + _rbsp_u(r, zeros));
+}
+
+static int32_t _rbsp_se(_rbsp_reader_t* r)
+{
+    uint32_t val = _rbsp_ue(r);
+    return (val & 1) ? (int32_t)((val + 1) / 2) : -(int32_t)(val / 2);
+}
+
+static void _avc_hrd_parameters(_rbsp_reader_t* r)
+{
+    uint32_t cpb_cnt_minus1 = _rbsp_ue(r);
+    _rbsp_u(r, 8); // bit_rate_scale, cpb_size_scale
+
+    for (uint32_t i = 0; !r->error && i <= cpb_cnt_minus1; ++i) {
+        _rbsp_ue(r); // bit_rate_value_minus1
+        _rbsp_ue(r); // cpb_size_value_minus1
+        _rbsp_u1(r); // cbr_flag
+    }
+
+    _rbsp_u(r, 20); // initial_cpb_removal_delay_length_minus1 .. time_offset_length
+}
+
+// Table A-1 MaxDpbMbs, used when the VUI does not carry max_num_reorder_frames
+#define AVC_MAX_DPB_MBS 696320
+static uint32_t _avc_max_dpb_mbs(uint8_t level_idc)
+{
+    switch (level_idc) {
+    case 9:
+    case 10: return 396;
+    case 11: return 900;
+    case 12:
+    case 13:
+    case 20: return 2376;
+    case 21: return 4752;
+    case 22:
+    case 30: return 8100;
+    case 31: return 18000;
+    case 32: return 20480;
+    case 40:
+    case 41: return 32768;
+    case 42: return 34816;
+    case 50: return 110400;
+    case 51:
+    case 52: return 184320;
+    default: return AVC_MAX_DPB_MBS;
+    }
+}
+
+// data points past the one byte NALU header. Returns max_num_reorder_frames, or -1 on error
+static int _avc_sps_reorder_frames(const uint8_t* data, size_t size)
+{
+    _rbsp_reader_t r = { data, size, 0, 0, 0, 0, 0 };
+    uint32_t profile_idc, constraint_flags, level_idc, chroma_format_idc = 1;
+    uint32_t pic_width_in_mbs, pic_height_in_map_units, frame_mbs_only_flag, max_dpb_frames;
+    uint64_t frame_mbs;
+
+    profile_idc = _rbsp_u(&r, 8);
+    constraint_flags = _rbsp_u(&r, 8);
+    level_idc = _rbsp_u(&r, 8);
+    _rbsp_ue(&r); // seq_parameter_set_id
+
+    if (100 == profile_idc || 110 == profile_idc || 122 == profile_idc || 244 == profile_idc || 44 == profile_idc || 83 == profile_idc || 86 == profile_idc || 118 == profile_idc || 128 == profile_idc || 138 == profile_idc || 139 == profile_idc || 134 == profile_idc || 135 == profile_idc) {
+        if (3 == (chroma_format_idc = _rbsp_ue(&r))) {
+            _rbsp_u1(&r); // separate_colour_plane_flag
+        }
+
+        _rbsp_ue(&r); // bit_depth_luma_minus8
+        _rbsp_ue(&r); // bit_depth_chroma_minus8
+        _rbsp_u1(&r); // qpprime_y_zero_transform_bypass_flag
+
+        if (_rbsp_u1(&r)) { // seq_scaling_matrix_present_flag
+            for (int i = 0; !r.error && i < (3 != chroma_format_idc ? 8 : 12); ++i) {
+                if (_rbsp_u1(&r)) { // seq_scaling_list_present_flag
+                    int32_t last = 8, next = 8;
+                    for (int j = 0; !r.error && j < (6 > i ? 16 : 64) && next; ++j) {
+                        next = (last + _rbsp_se(&r) + 256) % 256;
+                        last = next ? next : last;
+                    }
+                }
+            }
+        }
+    }
+
+    _rbsp_ue(&r); // log2_max_frame_num_minus4
+
+    switch (_rbsp_ue(&r)) { // pic_order_cnt_type
+    case 0:
+        _rbsp_ue(&r); // log2_max_pic_order_cnt_lsb_minus4
+        break;
+    case 1: {
+        _rbsp_u1(&r); // delta_pic_order_always_zero_flag
+        _rbsp_se(&r); // offset_for_non_ref_pic
+        _rbsp_se(&r); // offset_for_top_to_bottom_field
+        uint32_t num_ref_frames_in_pic_order_cnt_cycle = _rbsp_ue(&r);
+        for (uint32_t i = 0; !r.error && i < num_ref_frames_in_pic_order_cnt_cycle; ++i) {
+            _rbsp_se(&r); // offset_for_ref_frame
+        }
+    } break;
+    }
+
+    _rbsp_ue(&r); // max_num_ref_frames
+    _rbsp_u1(&r); // gaps_in_frame_num_value_allowed_flag
+    pic_width_in_mbs = _rbsp_ue(&r) + 1;
+    pic_height_in_map_units = _rbsp_ue(&r) + 1;
+
+    if (!(frame_mbs_only_flag = _rbsp_u1(&r))) {
+        _rbsp_u1(&r); // mb_adaptive_frame_field_flag
+    }
+
+    _rbsp_u1(&r); // direct_8x8_inference_flag
+
+    if (_rbsp_u1(&r)) { // frame_cropping_flag
+        _rbsp_ue(&r), _rbsp_ue(&r), _rbsp_ue(&r), _rbsp_ue(&r);
+    }
+
+    if (r.error) {
+        return -1;
+    }
+
+    // No level allows a frame bigger than this. Bound each side first so ue(v) + 1 can't wrap
+    if (!pic_width_in_mbs || !pic_height_in_map_units || AVC_MAX_DPB_MBS < pic_width_in_mbs || AVC_MAX_DPB_MBS < pic_height_in_map_units) {
+        return -1;
+    }
+
+    frame_mbs = (uint64_t)pic_width_in_mbs * pic_height_in_map_units * (2 - frame_mbs_only_flag);
+
+    if (AVC_MAX_DPB_MBS < frame_mbs) {
+        return -1;
+    }
+
+    // Inferred value when bitstream_restriction_flag is not set (E.2.1)
+    if ((44 == profile_idc || 86 == profile_idc || 100 == profile_idc || 110 == profile_idc || 122 == profile_idc || 244 == profile_idc) && (constraint_flags & 0x10)) {
+        max_dpb_frames = 0;
+    } else {
+        max_dpb_frames = _avc_max_dpb_mbs((uint8_t)level_idc) / (uint32_t)frame_mbs;
+        max_dpb_frames = 16 < max_dpb_frames ? 16 : max_dpb_frames;
+    }
+
+    if (!_rbsp_u1(&r)) { // vui_parameters_present_flag
+        return (int)max_dpb_frames;
+    }
+
+    if (_rbsp_u1(&r)) { // aspect_ratio_info_present_flag
+        if (255 == _rbsp_u(&r, 8)) { // Extended_SAR
+            _rbsp_u(&r, 32);
+        }
+    }
+
+    if (_rbsp_u1(&r)) { // overscan_info_present_flag
+        _rbsp_u1(&r);
+    }
+
+    if (_rbsp_u1(&r)) { // video_signal_type_present_flag
+        _rbsp_u(&r, 4);
+        if (_rbsp_u1(&r)) { // colour_description_present_flag
+            _rbsp_u(&r, 24);
+        }
+    }
+
+    if (_rbsp_u1(&r)) { // chroma_loc_info_present_flag
+        _rbsp_ue(&r), _rbsp_ue(&r);
+    }
+
+    if (_rbsp_u1(&r)) { // timing_info_present_flag
+        _rbsp_u(&r, 32), _rbsp_u(&r, 32), _rbsp_u1(&r);
+    }
+
+    uint32_t nal_hrd_parameters_present_flag = _rbsp_u1(&r);
+    if (nal_hrd_parameters_present_flag) {
+        _avc_hrd_parameters(&r);
+    }
+
+    uint32_t vcl_hrd_parameters_present_flag = _rbsp_u1(&r);
+    if (vcl_hrd_parameters_present_flag) {
+        _avc_hrd_parameters(&r);
+    }
+
+    if (nal_hrd_parameters_present_flag || vcl_hrd_parameters_present_flag) {
+        _rbsp_u1(&r); // low_delay_hrd_flag
+    }
+
+    _rbsp_u1(&r); // pic_struct_present_flag
+
+    if (_rbsp_u1(&r)) { // bitstream_restriction_flag
+        _rbsp_u1(&r); // motion_vectors_over_pic_boundaries_flag
+        _rbsp_ue(&r); // max_bytes_per_pic_denom
+        _rbsp_ue(&r); // max_bits_per_mb_denom
+        _rbsp_ue(&r); // log2_max_mv_length_horizontal
+        _rbsp_ue(&r); // log2_max_mv_length_vertical
+        uint32_t max_num_reorder_frames = _rbsp_ue(&r);
+        return r.error ? -1 : (int)max_num_reorder_frames;
+    }
+
+    return r.error ? -1 : (int)max_dpb_frames;
+}
+
+// data points past the two byte NALU header. Returns sps_max_num_reorder_pics[HighestTid], or -1 on error
+static int _hevc_sps_reorder_frames(const uint8_t* data, size_t size)
+{
+    _rbsp_reader_t r = { data, size, 0, 0, 0, 0, 0 };
+    uint32_t max_sub_layers_minus1, sub_layer_flags = 0, max_num_reorder_pics = 0;
+
+    _rbsp_u(&r, 4); // sps_video_parameter_set_id
+    max_sub_layers_minus1 = _rbsp_u(&r, 3);
+    _rbsp_u1(&r); // sps_temporal_id_nesting_flag
+
+    // profile_tier_level( 1, sps_max_sub_layers_minus1 )
+    _rbsp_u(&r, 32), _rbsp_u(&r, 32), _rbsp_u(&r, 24), _rbsp_u(&r, 8); // general profile, flags and level
+
+    for (uint32_t i = 0; i < max_sub_layers_minus1; ++i) {
+        sub_layer_flags = (sub_layer_flags << 2) | _rbsp_u(&r, 2);
+    }
+
+    if (0 < max_sub_layers_minus1) {
+        _rbsp_u(&r, 2 * (8 - max_sub_layers_minus1)); // reserved_zero_2bits
+    }
+
+    for (int i = (int)max_sub_layers_minus1 - 1; 0 <= i; --i) {
+        if (sub_layer_flags & (2u << (2 * i))) { // sub_layer_profile_present_flag
+            _rbsp_u(&r, 32), _rbsp_u(&r, 32), _rbsp_u(&r, 24);
+        }
+
+        if (sub_layer_flags & (1u << (2 * i))) { // sub_layer_level_present_flag
+            _rbsp_u(&r, 8);
+        }
+    }
+
+    _rbsp_ue(&r); // sps_seq_parameter_set_id
+
+    if (3 == _rbsp_ue(&r)) { // chroma_format_idc
+        _rbsp_u1(&r); // separate_colour_plane_flag
+    }
+
+    _rbsp_ue(&r); // pic_width_in_luma_samples
+    _rbsp_ue(&r); // pic_height_in_luma_samples
+
+    if (_rbsp_u1(&r)) { // conformance_window_flag
+        _rbsp_ue(&r), _rbsp_ue(&r), _rbsp_ue(&r), _rbsp_ue(&r);
+    }
+
+    _rbsp_ue(&r); // bit_depth_luma_minus8
+    _rbsp_ue(&r); // bit_depth_chroma_minus8
+    _rbsp_ue(&r); // log2_max_pic_order_cnt_lsb_minus4
+
+    for (uint32_t i = _rbsp_u1(&r) ? 0 : max_sub_layers_minus1; !r.error && i <= max_sub_layers_minus1; ++i) {
+        _rbsp_ue(&r); // sps_max_dec_pic_buffering_minus1
+        max_num_reorder_pics = _rbsp_ue(&r);
+        _rbsp_ue(&r); // sps_max_latency_increase_plus1
+    }
+
+    return r.error ? -1 : (int)max_num_reorder_pics;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SEI arena
+#define SEI_ARENA_ALIGN(size) (((size) + sizeof(double) - 1) & ~(sizeof(double) - 1))
+
+void sei_arena_init(sei_arena_t* arena)
+{
+    arena->head = 0;
+}
+
+void sei_arena_free(sei_arena_t* arena)
+{
+    sei_arena_block_t* next;
+
+    while (arena->head) {
+        next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+    }
+}
+
+void sei_arena_reset(sei_arena_t* arena)
+{
+    size_t capacity = 0;
+    sei_arena_block_t* block;
+
+    if (!arena->head) {
+        return;
+    }
+
+    if (!arena->head->next) {
+        arena->head->size = 0;
+        return;
+    }
+
+    // The arena grew during the last cycle. Replace all blocks with a single one large enough
+    for (block = arena->head; block; block = block->next) {
+        capacity += block->capacity;
+    }
+
+    sei_arena_free(arena);
+
+    if ((block = (sei_arena_block_t*)malloc(SEI_ARENA_ALIGN(sizeof(sei_arena_block_t)) + capacity))) {
+        block->size = 0;
+        block->capacity = capacity;
+        block->next = 0;
+        arena->head = block;
+    }
+}
+
+static void* _sei_arena_alloc(sei_arena_t* arena, size_t size)
+{
+    size_t capacity;
+    sei_arena_block_t* block = arena->head;
+    size = SEI_ARENA_ALIGN(size);
+
+    if (!block || block->capacity - block->size < size) {
+        capacity = block ? 2 * block->capacity : MIN_SEI_ARENA_SIZE;
+        capacity = size > capacity ? size : capacity;
+
+        if (!(block = (sei_arena_block_t*)malloc(SEI_ARENA_ALIGN(sizeof(sei_arena_block_t)) + capacity))) {
+            return 0;
+        }
+
+        block->size = 0;
+        block->capacity = capacity;
+        block->next = arena->head;
+        arena->head = block;
+    }
+
+    block->size += size;
+    return ((uint8_t*)block) + SEI_ARENA_ALIGN(sizeof(sei_arena_block_t)) + block->size - size;
+}
+////////////////////////////////////////////////////////////////////////////////
 void sei_init(sei_t* sei, double timestamp)
 {
     sei->head = 0;
     sei->tail = 0;
+    sei->arena = 0;
     sei->timestamp = timestamp;
 }
 
@@ -100,6 +549,11 @@ void sei_free(sei_t* sei)
 {
     sei_message_t* tail;
 
+    if (sei->arena) {
+        sei_arena_reset(sei->arena);
+        sei->head = 0;
+    }
+
     while (sei->head) {
         tail = sei->head->next;
         free(sei->head);
@@ -109,15 +563,22 @@ void sei_free(sei_t* sei)
     sei_init(sei, 0);
 }
 
-
-
-
+static sei_message_t* _sei_message_alloc(sei_t* sei, size_t size)
+{
+    return (sei_message_t*)(sei->arena ? _sei_arena_alloc(sei->arena, sizeof(sei_message_t) + size) : malloc(sizeof(sei_message_t) + size));
+}
 ////////////////////////////////////////////////////////////////////////////////
 
 //00 00 01 06 data -->>> 04 44 B5 00 2F 03 3F D4 FF
 libcaption_stauts_t sei_parse(sei_t* sei, const uint8_t* data, size_t size, double timestamp)
+{
+    return sei_parse_arena(sei, 0, data, size, timestamp, 0);
+}
+
+libcaption_stauts_t sei_parse_arena(sei_t* sei, sei_arena_t* arena, const uint8_t* data, size_t size, double timestamp, int itu_t_t35)
 {
     sei_init(sei, timestamp);
+    sei->arena = arena;
     int ret = 0;
 
     // SEI may contain more than one payload
@@ -149,16 +610,45 @@ libcaption_stauts_t sei_parse(sei_t* sei, const uint8_t* data, size_t size, doub
         payloadSize += (*data);
         ++data, --size;
 
-        if (payloadSize) {
+        if (payloadSize && itu_t_t35 && sei_type_user_data_registered_itu_t_t35 != payloadType) {
+            // Fast path, step over the payload without allocating or copying it
+            size_t bytes = _copy_to_rbsp(0, payloadSize, data, size);
+
+            if (bytes < payloadSize) {
+                return LIBCAPTION_ERROR;
+            }
+
+            data += bytes;
+            size -= bytes;
+        } else if (payloadSize) {
             //sei_message_t* msg = sei_message_new((sei_msgtype_t)payloadType, 0, payloadSize);
 
-            struct _sei_message_t* msg = (struct _sei_message_t*)malloc(sizeof(struct _sei_message_t) + size);
+            struct _sei_message_t* msg;
+            size_t bytes;
+
+            if (arena && payloadSize < size && payloadSize == _find_emulation_prevention_byte(data, payloadSize)) {
+                // No emulation prevention bytes, the escaped payload is already RBSP. Reference it in place.
+                // Only for arena messages, which like data are released before the next NALU is buffered
+                if (!(msg = _sei_message_alloc(sei, 0))) {
+                    return LIBCAPTION_ERROR;
+                }
+
+                msg->payload = (uint8_t*)data;
+                bytes = payloadSize;
+            } else {
+                if (!(msg = _sei_message_alloc(sei, payloadSize))) {
+                    return LIBCAPTION_ERROR;
+                }
+
+                msg->payload = ((uint8_t*)msg) + sizeof(struct _sei_message_t);
+                if (0 == (bytes = _copy_to_rbsp(msg->payload, payloadSize, data, size))) {
+                    memset(msg->payload, 0, payloadSize);
+                }
+            }
+
             msg->next = 0;
             msg->type = payloadType;
             msg->size = payloadSize;
-            msg->payload = ((uint8_t*)msg) + sizeof(struct _sei_message_t);
-            memset(msg->payload, 0, size);
-            size_t bytes = _copy_to_rbsp(msg->payload, payloadSize, data, size);
 
 
             if (sei->head == 0) {
@@ -191,148 +681,544 @@ libcaption_stauts_t sei_parse(sei_t* sei, const uint8_t* data, size_t size, doub
 // bitstream
 void mpeg_bitstream_init(mpeg_bitstream_t* packet)
 {
-    packet->dts = 0;
-    packet->cts = 0;
+    packet->calls = 0;
+    packet->pos = 0;
     packet->size = 0;
-    packet->front = 0;
+    packet->capacity = 0;
+    packet->data = 0;
+    packet->scan = 0;
+    packet->skip = 1;
+    packet->zeros = 0;
+    packet->stream_type = STREAM_TYPE_H264;
     packet->latent = 0;
+    packet->reorder = MAX_REFRENCE_FRAMES;
+    packet->sequence = 0;
     packet->status = LIBCAPTION_OK;
+
+    for (size_t i = 0; i < MAX_REFRENCE_FRAMES; ++i) {
+        packet->heap[i] = (uint8_t)i;
+    }
+
+    sei_arena_init(&packet->arena);
+}
+
+void mpeg_bitstream_free(mpeg_bitstream_t* packet)
+{
+    free(packet->data);
+    packet->data = 0;
+    packet->pos = 0;
+    packet->size = 0;
+    packet->capacity = 0;
+    packet->calls = 0;
+    sei_arena_free(&packet->arena);
+}
+
+// Makes room for size more bytes after the unconsumed data.
+// Consumed bytes are only reclaimed here, so the pending NALU is moved at most once per refill
+static int _mpeg_bitstream_reserve(mpeg_bitstream_t* packet, size_t size)
+{
+    size_t capacity;
+    uint8_t* data;
+
+    if (packet->pos + packet->size + size <= packet->capacity) {
+        return 1;
+    }
+
+    if (packet->pos) {
+        memmove(&packet->data[0], &packet->data[packet->pos], packet->size);
+        packet->pos = 0;
+    }
+
+    if (packet->size + size <= packet->capacity) {
+        return 1;
+    }
+
+    capacity = packet->capacity ? packet->capacity : MIN_NALU_BUFFER_SIZE;
+    while (capacity < packet->size + size) {
+        capacity *= 2;
+    }
+
+    if (MAX_NALU_SIZE + 1 < capacity) {
+        capacity = MAX_NALU_SIZE + 1;
+    }
+
+    if (0 == (data = (uint8_t*)realloc(packet->data, capacity))) {
+        return 0;
+    }
+
+    packet->data = data;
+    packet->capacity = capacity;
+    return 1;
+}
+
+// Gives memory back after a large NALU (IDR slice) has been consumed
+static void _mpeg_bitstream_shrink(mpeg_bitstream_t* packet)
+{
+    size_t capacity = packet->capacity / 2;
+    uint8_t* data;
+
+    if (MIN_NALU_BUFFER_SIZE > capacity || packet->size >= capacity / 2) {
+        return;
+    }
+
+    if (packet->pos) {
+        memmove(&packet->data[0], &packet->data[packet->pos], packet->size);
+        packet->pos = 0;
+    }
+
+    if ((data = (uint8_t*)realloc(packet->data, capacity))) {
+        packet->data = data;
+        packet->capacity = capacity;
+    }
 }
 
 
-static size_t find_start_code(const uint8_t* data, size_t size)
+// Returns the offset of the first start code at or after from that is followed by at least one byte, 0 if there is none
+static size_t find_start_code(const uint8_t* data, size_t size, size_t from)
 {
-    uint32_t start_code = 0xffffffff;
-    for (size_t i = 1; i < size; ++i) {
-        start_code = (start_code << 8) | data[i];
-        if (0x00000100 == (start_code & 0xffffff00)) {
-            return i - 3;
+    size_t pos;
+
+    if (4 > size || from >= size - 1) {
+        return 0;
+    }
+
+    pos = _find_zero_zero(data, size - 1, from, 0x01);
+    return pos < size - 1 ? pos : 0;
+}
+
+static const uint8_t _start_code[3] = { 0x00, 0x00, 0x01 };
+
+// Returns the offset just past the next 00 00 01, or 0 if there is none.
+// zeros carries the number of trailing zero bytes from one call to the next
+static size_t _find_start_code_end(const uint8_t* data, size_t size, size_t* zeros)
+{
+    size_t i;
+
+    // A start code split across calls can only end in the first two bytes
+    for (i = 0; i < size && i < 2; ++i) {
+        if (0x00 == data[i]) {
+            ++(*zeros);
+        } else if (0x01 == data[i] && 2 <= (*zeros)) {
+            (*zeros) = 0;
+            return i + 1;
+        } else {
+            (*zeros) = 0;
         }
     }
+
+    if (2 < size) {
+        if ((i = _find_zero_zero(data, size, 0, 0x01)) < size) {
+            (*zeros) = 0;
+            return i + 3;
+        }
+
+        (*zeros) = 0x00 != data[size - 1] ? 0 : 0x00 != data[size - 2] ? 1 : 2;
+    }
+
     return 0;
 }
 
-// WILL wrap around if larger than MAX_REFRENCE_FRAMES for memory saftey
-cea708_t* _mpeg_bitstream_cea708_at(mpeg_bitstream_t* packet, size_t pos) { return &packet->cea708[(packet->front + pos) % MAX_REFRENCE_FRAMES]; }
+// For MPEG-2 this is the full start code value
+static unsigned _mpeg_bitstream_nalu_type(const uint8_t* nalu, unsigned stream_type)
+{
+    return STREAM_TYPE_H265 == stream_type ? ((nalu[3] >> 1) & 0x3F) : STREAM_TYPE_H262 == stream_type ? nalu[3] : (nalu[3] & 0x1F);
+}
+
+static int _mpeg_bitstream_nalu_is_sei(const uint8_t* nalu, unsigned stream_type)
+{
+    unsigned type = _mpeg_bitstream_nalu_type(nalu, stream_type);
+
+    switch (stream_type) {
+    case STREAM_TYPE_H262: return H262_SEI_PACKET == type;
+    case STREAM_TYPE_H265: return H265_SEI_PACKET == type || H265_SEI_SUFFIX_PACKET == type;
+    default: return H264_SEI_PACKET == type;
+    }
+}
 
-cea708_t* _mpeg_bitstream_cea708_emplace_back(mpeg_bitstream_t* packet, double timestamp)
+// For MPEG-2, the sequence extension carries low_delay
+static int _mpeg_bitstream_nalu_is_sps(const uint8_t* nalu, unsigned stream_type)
 {
-    ++packet->latent;
-    cea708_t* cea708 = _mpeg_bitstream_cea708_at(packet, packet->latent - 1);
-    cea708_init(cea708, timestamp);
-    return cea708;
+    unsigned type = _mpeg_bitstream_nalu_type(nalu, stream_type);
+
+    switch (stream_type) {
+    case STREAM_TYPE_H262: return H262_EXTENSION_PACKET == type && 0x10 == (nalu[4] & 0xF0);
+    case STREAM_TYPE_H265: return H265_SPS_PACKET == type;
+    default: return H264_SPS_PACKET == type;
+    }
 }
 
-void _mpeg_bitstream_cea708_sort(mpeg_bitstream_t* packet)
+// Only SEI and SPS NALUs are ever parsed, everything else is skipped without buffering
+static int _mpeg_bitstream_nalu_wanted(const uint8_t* nalu, unsigned stream_type)
 {
-    // TODO better sort? (for small nearly sorted lists bubble is difficult to beat)
-    // This must be stable, decending sort
-again:
-    for (size_t i = 1; i < packet->latent; ++i) {
-        cea708_t c;
-        cea708_t* a = _mpeg_bitstream_cea708_at(packet, i - 1);
-        cea708_t* b = _mpeg_bitstream_cea708_at(packet, i);
-        if (a->timestamp > b->timestamp) {
-            memcpy(&c, a, sizeof(cea708_t));
-            memcpy(a, b, sizeof(cea708_t));
-            memcpy(b, &c, sizeof(cea708_t));
-            goto again;
+    return _mpeg_bitstream_nalu_is_sei(nalu, stream_type) || _mpeg_bitstream_nalu_is_sps(nalu, stream_type);
+}
+
+// Sets the number of frames the decoder may hold back for reordering, MAX_REFRENCE_FRAMES if unknown
+static void _mpeg_bitstream_parse_sps(mpeg_bitstream_t* packet, const uint8_t* nalu, size_t size, unsigned stream_type)
+{
+    int reorder;
+
+    switch (stream_type) {
+    case STREAM_TYPE_H262:
+        // Without low_delay, B pictures delay their anchor by exactly one picture
+        reorder = 10 <= size ? !(nalu[9] & 0x80) : -1;
+        break;
+    case STREAM_TYPE_H265:
+        reorder = _hevc_sps_reorder_frames(&nalu[5], size - 5);
+        break;
+    default:
+        reorder = _avc_sps_reorder_frames(&nalu[4], size - 4);
+        break;
+    }
+
+    packet->reorder = (0 > reorder || MAX_REFRENCE_FRAMES < reorder) ? MAX_REFRENCE_FRAMES : (size_t)reorder;
+}
+
+// Records that size bytes were buffered by a call with these timestamps
+static void _mpeg_bitstream_append(mpeg_bitstream_t* packet, size_t size, double dts, double cts)
+{
+    size_t last = packet->calls - 1;
+
+    if (!size) {
+        return;
+    }
+
+    if (packet->calls && (MAX_BUFFERED_CALLS == packet->calls || (dts == packet->call[last].dts && cts == packet->call[last].cts))) {
+        packet->call[last].size += size;
+        return;
+    }
+
+    packet->call[packet->calls].size = size;
+    packet->call[packet->calls].dts = dts;
+    packet->call[packet->calls].cts = cts;
+    ++packet->calls;
+}
+
+// Removes size bytes from the front of the buffer, with the timestamps of calls that no longer have any bytes in it
+static void _mpeg_bitstream_consume(mpeg_bitstream_t* packet, size_t size)
+{
+    packet->pos += size;
+    packet->size -= size;
+
+    while (size && packet->calls) {
+        if (size < packet->call[0].size) {
+            packet->call[0].size -= size;
+            return;
         }
+
+        size -= packet->call[0].size;
+        memmove(&packet->call[0], &packet->call[1], --packet->calls * sizeof(packet->call[0]));
     }
 }
 
+// Drops the incomplete NALU at the front of the buffer and switches to skip mode.
+// find_start_code needs a byte after 00 00 01, so recheck the last three bytes
+static void _mpeg_bitstream_skip(mpeg_bitstream_t* packet, size_t header_size)
+{
+    size_t tail = packet->size - 3 > header_size ? packet->size - 3 : header_size;
+    size_t end;
+
+    packet->zeros = 0;
+    if ((end = _find_start_code_end(&packet->data[packet->pos + tail], packet->size - tail, &packet->zeros))) {
+        _mpeg_bitstream_consume(packet, tail + end - 3);
+        packet->scan = 0;
+        return;
+    }
+
+    packet->pos = 0;
+    packet->size = 0;
+    packet->scan = 0;
+    packet->skip = 1;
+    packet->calls = 0;
+}
 
+static int _mpeg_bitstream_cea708_less(mpeg_bitstream_t* packet, size_t a, size_t b)
+{
+    uint8_t sa = packet->heap[a], sb = packet->heap[b];
+    double ta = packet->cea708[sa].timestamp, tb = packet->cea708[sb].timestamp;
+    return ta < tb || (ta == tb && packet->order[sa] < packet->order[sb]);
+}
 
+static void _mpeg_bitstream_cea708_swap(mpeg_bitstream_t* packet, size_t a, size_t b)
+{
+    uint8_t slot = packet->heap[a];
+    packet->heap[a] = packet->heap[b];
+    packet->heap[b] = slot;
+}
 
-size_t mpeg_bitstream_parse(const uint8_t* tsPacket, mpeg_bitstream_t* packet, caption_frame_t* frame, const uint8_t* data, size_t size, unsigned stream_type, double dts, double cts)
+// Earliest queued frame, or 0 if the queue is empty
+static cea708_t* _mpeg_bitstream_cea708_front(mpeg_bitstream_t* packet)
 {
-    if (MAX_NALU_SIZE <= packet->size) {
-        packet->status = LIBCAPTION_ERROR;
-        // fprintf(stderr, "LIBCAPTION_ERROR\n");
-        return 0;
+    return packet->latent ? &packet->cea708[packet->heap[0]] : 0;
+}
+
+// Caller must make sure the queue is not full
+static cea708_t* _mpeg_bitstream_cea708_emplace(mpeg_bitstream_t* packet, double timestamp)
+{
+    size_t i = packet->latent++;
+    uint8_t slot = packet->heap[i];
+    cea708_init(&packet->cea708[slot], timestamp);
+    packet->order[slot] = packet->sequence++;
+
+    while (0 < i && _mpeg_bitstream_cea708_less(packet, i, (i - 1) / 2)) {
+        _mpeg_bitstream_cea708_swap(packet, i, (i - 1) / 2);
+        i = (i - 1) / 2;
     }
 
-    // consume upto MAX_NALU_SIZE bytes
-    if (MAX_NALU_SIZE <= packet->size + size) {
-        size = MAX_NALU_SIZE - packet->size;
+    return &packet->cea708[slot];
+}
+
+static void _mpeg_bitstream_cea708_pop(mpeg_bitstream_t* packet)
+{
+    size_t i = 0, child;
+
+    if (!packet->latent) {
+        return;
+    }
+
+    // Move the last entry to the root, this also returns the popped slot to the free list
+    _mpeg_bitstream_cea708_swap(packet, 0, --packet->latent);
+
+    while ((child = 2 * i + 1) < packet->latent) {
+        if (child + 1 < packet->latent && _mpeg_bitstream_cea708_less(packet, child + 1, child)) {
+            ++child;
+        }
+
+        if (!_mpeg_bitstream_cea708_less(packet, child, i)) {
+            break;
+        }
+
+        _mpeg_bitstream_cea708_swap(packet, i, child);
+        i = child;
+    }
+}
+
+// Decodes into every channel when channels is set, otherwise into frame
+static libcaption_stauts_t _mpeg_bitstream_cea708_decode(caption_frame_t* frame, caption_channels_t* channels, cea708_t* cea708)
+{
+    return channels ? cea708_to_caption_channels(channels, cea708) : cea708_to_caption_frame(frame, cea708);
+}
+
+// Queues a frame for release in presentation order. If the queue is full the earliest frame is released first
+static cea708_t* _mpeg_bitstream_cea708_push(mpeg_bitstream_t* packet, caption_frame_t* frame, caption_channels_t* channels, double timestamp)
+{
+    if (MAX_REFRENCE_FRAMES == packet->latent) {
+        packet->status = libcaption_status_update(packet->status, _mpeg_bitstream_cea708_decode(frame, channels, _mpeg_bitstream_cea708_front(packet)));
+        _mpeg_bitstream_cea708_pop(packet);
+    }
+
+    return _mpeg_bitstream_cea708_emplace(packet, timestamp);
+}
+
+// Releases queued frames that no later frame can be presented before.
+// Loop will terminate on LIBCAPTION_READY
+static void _mpeg_bitstream_cea708_release(mpeg_bitstream_t* packet, caption_frame_t* frame, caption_channels_t* channels, double dts)
+{
+    cea708_t* cea708;
+
+    while (packet->latent && LIBCAPTION_OK == packet->status) {
+        cea708 = _mpeg_bitstream_cea708_front(packet);
+
+        // Once more than reorder frames are queued, no later frame can be presented before the earliest one
+        if (packet->latent <= packet->reorder && cea708->timestamp >= dts) {
+            break;
+        }
+
+        LIBCAPTION_TRACE(MPEG, DEBUG, "release timestamp=%f dts=%f latent=%u\n", cea708->timestamp, dts, (unsigned)packet->latent);
+        packet->status = libcaption_status_update(LIBCAPTION_OK, _mpeg_bitstream_cea708_decode(frame, channels, cea708));
+        _mpeg_bitstream_cea708_pop(packet);
     }
+}
+
+// ATSC A/53 picture user data carrying cc_data()
+static int _mpeg_bitstream_is_a53_cc_data(const uint8_t* data, size_t size)
+{
+    return 5 <= size && GA94 == (uint32_t)((data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3]) && 3 == data[4];
+}
 
+// start code plus the NALU header, which is two bytes in HEVC
+static size_t _mpeg_bitstream_header_size(unsigned stream_type) { return STREAM_TYPE_H265 == stream_type ? 5 : 4; }
+
+// nalu starts at its three byte start code and holds exactly one complete NALU
+static void _mpeg_bitstream_parse_nalu(mpeg_bitstream_t* packet, caption_frame_t* frame, caption_channels_t* channels, const uint8_t* nalu, size_t size, unsigned stream_type, double dts, double cts)
+{
     sei_t seiMsgHolder;
     libcaption_stauts_t new_paket_status;
+    size_t header_size = _mpeg_bitstream_header_size(stream_type);
+
+    if (_mpeg_bitstream_nalu_is_sps(nalu, stream_type)) {
+        _mpeg_bitstream_parse_sps(packet, nalu, size, stream_type);
+    } else if (STREAM_TYPE_H262 == stream_type && _mpeg_bitstream_nalu_is_sei(nalu, stream_type)) {
+        // MPEG-2 has no emulation prevention, so the user data is parsed in place
+        if (_mpeg_bitstream_is_a53_cc_data(&nalu[header_size], size - header_size)) {
+            cea708_t* cea708 = _mpeg_bitstream_cea708_push(packet, frame, channels, dts + cts);
+            new_paket_status = cea708_parse_h262(&nalu[header_size], size - header_size, cea708);
+            packet->status = libcaption_status_update(packet->status, new_paket_status);
+            _mpeg_bitstream_cea708_release(packet, frame, channels, dts);
+        }
+    } else if (_mpeg_bitstream_nalu_is_sei(nalu, stream_type)) {
+        new_paket_status = sei_parse_arena(&seiMsgHolder, &packet->arena, &nalu[header_size], size - header_size, dts + cts, 1);
+        packet->status = libcaption_status_update(packet->status, new_paket_status);
+
+        // All caption payloads of an access unit share one queue entry, so the reorder window counts pictures
+        cea708_t* cea708 = 0;
+
+        for (sei_message_t* msg = seiMsgHolder.head; msg; msg = msg->next) {
+            switch (msg->type) {
+            case sei_type_user_data_registered_itu_t_t35:
+                if (!cea708) {
+                    cea708 = _mpeg_bitstream_cea708_push(packet, frame, channels, dts + cts);
+                    new_paket_status = cea708_parse_h264(msg->payload, msg->size, cea708);
+                } else {
+                    cea708_t extra;
+                    cea708_init(&extra, dts + cts);
+                    new_paket_status = cea708_parse_h264(msg->payload, msg->size, &extra);
+                    cea708_cat(cea708, &extra);
+                }
+
+                packet->status = libcaption_status_update(packet->status, new_paket_status);
+                break;
+
+            default:
+                break;
+            }
+        }
 
-    size_t header_size, scpos;
-    packet->status = LIBCAPTION_OK;
-    memcpy(&packet->data[packet->size], data, size);
-    packet->size += size;
+        if (cea708) {
+            _mpeg_bitstream_cea708_release(packet, frame, channels, dts);
+        }
 
-    header_size = 4;
+        sei_free(&seiMsgHolder);
+    }
+}
 
-    while (packet->status == LIBCAPTION_OK) {
+static size_t _mpeg_bitstream_parse(mpeg_bitstream_t* packet, caption_frame_t* frame, caption_channels_t* channels, const uint8_t* data, size_t size, unsigned stream_type, double dts, double cts)
+{
+    size_t skipped = 0;
+    packet->status = LIBCAPTION_OK;
 
-    	if ((scpos = find_start_code(&packet->data[0], packet->size)) <= header_size){
-    		break;
-    	}
-    	if ((packet->size > 4) && ((packet->data[3] & 0x1F) == H264_SEI_PACKET)){
+    if (packet->skip) {
+        // Inside a NALU we never parse (slice data). Drop bytes without buffering them
+        if (0 == (skipped = _find_start_code_end(data, size, &packet->zeros))) {
+            return size;
+        }
 
-    		new_paket_status = sei_parse(&seiMsgHolder, &packet->data[header_size], scpos - header_size, dts + cts);
-			packet->status = libcaption_status_update(packet->status, new_paket_status);
+        // Resume buffering at the start code that ended the dropped NALU
+        if (!_mpeg_bitstream_reserve(packet, 3)) {
+            packet->status = LIBCAPTION_ERROR;
+            return 0;
+        }
 
+        memcpy(&packet->data[packet->pos + packet->size], _start_code, 3);
+        packet->size += 3;
+        packet->skip = 0;
+        _mpeg_bitstream_append(packet, 3, dts, cts);
+        data += skipped, size -= skipped;
+    }
 
-			int count = 0;
-			int count2 = 0;
+    if (MAX_NALU_SIZE <= packet->size) {
+        packet->status = LIBCAPTION_ERROR;
+        // fprintf(stderr, "LIBCAPTION_ERROR\n");
+        return skipped;
+    }
 
-    		//for (sei_message_t* msg = seiMsgHolder.head; msg; msg = msg->next) {
+    // consume upto MAX_NALU_SIZE bytes
+    if (MAX_NALU_SIZE <= packet->size + size) {
+        size = MAX_NALU_SIZE - packet->size;
+    }
 
-    			sei_message_t* msg = seiMsgHolder.head;
+    if (!_mpeg_bitstream_reserve(packet, size)) {
+        packet->status = LIBCAPTION_ERROR;
+        return skipped;
+    }
 
-    			if (msg->type == sei_type_user_data_registered_itu_t_t35) {
+    size_t header_size, scpos;
+    uint8_t* nalu;
+    memcpy(&packet->data[packet->pos + packet->size], data, size);
+    packet->size += size;
+    _mpeg_bitstream_append(packet, size, dts, cts);
+    packet->stream_type = stream_type;
+    header_size = _mpeg_bitstream_header_size(stream_type);
 
-    				printf("count=%d\n",count++);
-    				++packet->latent;
-     			    cea708_t* cea708 = _mpeg_bitstream_cea708_at(packet, packet->latent - 1);
-    			    cea708_init(cea708, dts + cts);
-    			    new_paket_status = cea708_parse_h264(msg->payload, msg->size, cea708);
-    			    packet->status = libcaption_status_update(packet->status, new_paket_status);
+    while (packet->status == LIBCAPTION_OK) {
+    	nalu = &packet->data[packet->pos];
+
+    	// Resume where the previous call stopped rather than rescanning the whole NALU
+    	if (0 == (scpos = find_start_code(nalu, packet->size, header_size < packet->scan ? packet->scan : header_size + 1))){
+    		if (header_size < packet->size && !_mpeg_bitstream_nalu_wanted(nalu, stream_type)) {
+    			_mpeg_bitstream_skip(packet, header_size);
+    		} else if (3 < packet->size) {
+    			packet->scan = packet->size - 3;
+    		}
+    		break;
+    	}
+    	_mpeg_bitstream_parse_nalu(packet, frame, channels, nalu, scpos, stream_type, packet->call[0].dts, packet->call[0].cts);
+        _mpeg_bitstream_consume(packet, scpos);
+        packet->scan = 0;
+    }
 
+    if (0 == packet->size) {
+        packet->pos = 0;
+    }
 
+    _mpeg_bitstream_shrink(packet);
+    return skipped + size;
+}
 
 
-    			    _mpeg_bitstream_cea708_sort(packet);
+size_t mpeg_bitstream_parse(const uint8_t* tsPacket, mpeg_bitstream_t* packet, caption_frame_t* frame, const uint8_t* data, size_t size, unsigned stream_type, double dts, double cts)
+{
+    return _mpeg_bitstream_parse(packet, frame, 0, data, size, stream_type, dts, cts);
+}
 
-    			    // Loop will terminate on LIBCAPTION_READY
-    			    //while (packet->latent && packet->status == LIBCAPTION_OK && (cea708 =_mpeg_bitstream_cea708_at(packet, 0))->timestamp < dts) {
-   			    	while (1) {
+size_t mpeg_bitstream_parse_channels(mpeg_bitstream_t* packet, caption_channels_t* channels, const uint8_t* data, size_t size, unsigned stream_type, double dts, double cts)
+{
+    return _mpeg_bitstream_parse(packet, 0, channels, data, size, stream_type, dts, cts);
+}
 
-    			    	if (packet->latent == 0){
-    			    		printf("Exit packet->latent == 0\n");
-    			    		break;
-    			    	}
-    			    	if (packet->status != LIBCAPTION_OK){
-    			    		printf("Exit status != LIBCAPTION_OK\n");
-    			    		break;
-    			    	}
-    			    	if ((cea708 =_mpeg_bitstream_cea708_at(packet, 0))->timestamp >= dts){
-    			    		printf("Exit timestamp >= dts\n");
-    			    		break;
-    			    	}
+static size_t _mpeg_bitstream_flush(mpeg_bitstream_t* packet, caption_frame_t* frame, caption_channels_t* channels)
+{
+    size_t header_size = _mpeg_bitstream_header_size(packet->stream_type), scpos;
+    packet->status = LIBCAPTION_OK;
 
-    			    	printf("count2=%d\n",count2++);
-    			    	new_paket_status = cea708_to_caption_frame(frame, cea708);
-    			    	packet->status   = libcaption_status_update(LIBCAPTION_OK, new_paket_status);
-    			    	packet->front = (packet->front + 1) % MAX_REFRENCE_FRAMES;
-    			    	--packet->latent;
+    // Nothing else is coming, so every buffered NALU is complete. A LIBCAPTION_READY can leave
+    // several behind, each is parsed with the timestamps of the call that passed it in
+    while (LIBCAPTION_OK == packet->status && !packet->skip && header_size < packet->size) {
+        if (0 == (scpos = find_start_code(&packet->data[packet->pos], packet->size, header_size + 1))) {
+            scpos = packet->size;
+        }
 
-    			    }
-    			}
-    		//}
-    		sei_free(&seiMsgHolder);
+        _mpeg_bitstream_parse_nalu(packet, frame, channels, &packet->data[packet->pos], scpos, packet->stream_type, packet->call[0].dts, packet->call[0].cts);
+        _mpeg_bitstream_consume(packet, scpos);
+    }
 
-    	}
+    // Stopped early, the remaining NALUs are parsed by the next call
+    if (!packet->skip && header_size < packet->size) {
+        return packet->latent + 1;
+    }
 
-        packet->size -= scpos;
-        memmove(&packet->data[0], &packet->data[scpos], packet->size);
+    // Ready for the next segment
+    packet->pos = 0;
+    packet->size = 0;
+    packet->scan = 0;
+    packet->skip = 1;
+    packet->zeros = 0;
+    packet->calls = 0;
+
+    while (packet->latent && LIBCAPTION_OK == packet->status) {
+        packet->status = libcaption_status_update(LIBCAPTION_OK, _mpeg_bitstream_cea708_decode(frame, channels, _mpeg_bitstream_cea708_front(packet)));
+        _mpeg_bitstream_cea708_pop(packet);
     }
 
-    return size;
+    return packet->latent;
 }
 
+size_t mpeg_bitstream_flush(mpeg_bitstream_t* packet, caption_frame_t* frame)
+{
+    return _mpeg_bitstream_flush(packet, frame, 0);
+}
+
+size_t mpeg_bitstream_flush_channels(mpeg_bitstream_t* packet, caption_channels_t* channels)
+{
+    return _mpeg_bitstream_flush(packet, 0, channels);
+}
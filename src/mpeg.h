@@ -36,40 +36,119 @@ extern "C" {
 #define STREAM_TYPE_H262 0x02
 #define STREAM_TYPE_H264 0x1B
 #define STREAM_TYPE_H265 0x24
-#define H262_SEI_PACKET 0xB2
+#define H262_SEI_PACKET 0xB2 // user_data_start_code
+#define H262_EXTENSION_PACKET 0xB5
 #define H264_SEI_PACKET 0x06
-#define H265_SEI_PACKET 0x27 // There is also 0x28
+#define H264_SPS_PACKET 0x07
+#define H265_SEI_PACKET 0x27 // Prefix SEI
+#define H265_SEI_SUFFIX_PACKET 0x28
+#define H265_SPS_PACKET 0x21
 #define MAX_NALU_SIZE (6 * 1024 * 1024)
+#define MIN_NALU_BUFFER_SIZE (8 * 1024)
 #define MAX_REFRENCE_FRAMES 64
+#define MAX_BUFFERED_CALLS 8
+#define MIN_SEI_ARENA_SIZE (4 * 1024)
+////////////////////////////////////////////////////////////////////////////////
+// Bump allocator for sei_message_t. Memory is reused after sei_arena_reset
+// so steady state parsing does not touch the heap
+typedef struct _sei_arena_block_t {
+    size_t size;
+    size_t capacity;
+    struct _sei_arena_block_t* next;
+} sei_arena_block_t;
+
 typedef struct {
+    sei_arena_block_t* head;
+} sei_arena_t;
+
+/*! \brief
+    \param
+*/
+void sei_arena_init(sei_arena_t* arena);
+/*! \brief
+        Releases all memory held by the arena
+    \param
+*/
+void sei_arena_free(sei_arena_t* arena);
+/*! \brief
+        Invalidates all allocations. O(1) unless the arena had to grow since the last reset,
+        in which case blocks are merged so the next cycle fits in one
+    \param
+*/
+void sei_arena_reset(sei_arena_t* arena);
+////////////////////////////////////////////////////////////////////////////////
+typedef struct {
+    // Growable NALU buffer. Unconsumed bytes live in data[pos, pos + size)
+    // Capacity starts at MIN_NALU_BUFFER_SIZE, grows up to MAX_NALU_SIZE + 1
+    // and shrinks again once large NALUs have been consumed
+    size_t pos;
     size_t size;
-    uint8_t data[MAX_NALU_SIZE + 1];
-    double dts, cts;
+    size_t capacity;
+    uint8_t* data;
+    // Offset from pos where the next start code search resumes
+    size_t scan;
+    // Set while inside a NALU that is not parsed. Its bytes are dropped up to the next
+    // start code instead of being buffered. zeros counts trailing 0x00 bytes seen so far
+    int skip;
+    size_t zeros;
+    sei_arena_t arena;
+    unsigned stream_type;
+    // Timestamps of the calls whose bytes are still buffered, oldest first. A NALU is parsed with
+    // the timestamps of the call that passed in its start code, even when a LIBCAPTION_READY
+    // left it for a later call. Past MAX_BUFFERED_CALLS the newest entry takes the extra bytes
+    size_t calls;
+    struct {
+        size_t size;
+        double dts, cts;
+    } call[MAX_BUFFERED_CALLS];
     libcaption_stauts_t status;
     // Priority queue for out of order frame processing
-    // Should probablly be a linked list
-    size_t front;
+    // heap[0, latent) is a binary min-heap of cea708 slot indices ordered by timestamp,
+    // then by arrival so equal timestamps stay stable. heap[latent, MAX_REFRENCE_FRAMES)
+    // holds the free slots. Payloads never move, only their indices do
     size_t latent;
+    size_t reorder; // max_num_reorder_frames from the SPS, MAX_REFRENCE_FRAMES until one is seen
+    size_t sequence;
+    uint8_t heap[MAX_REFRENCE_FRAMES];
+    size_t order[MAX_REFRENCE_FRAMES];
     cea708_t cea708[MAX_REFRENCE_FRAMES];
 } mpeg_bitstream_t;
 
 void mpeg_bitstream_init(mpeg_bitstream_t* packet);
+/*! \brief
+        Releases the NALU buffer. packet may be reused after calling mpeg_bitstream_init
+    \param
+*/
+void mpeg_bitstream_free(mpeg_bitstream_t* packet);
 ////////////////////////////////////////////////////////////////////////////////
 // TODO make convenience functions for flv/mp4
 /*! \brief
     \param
 */
 size_t mpeg_bitstream_parse(const uint8_t* tsPacket, mpeg_bitstream_t* packet, caption_frame_t* frame, const uint8_t* data, size_t size, unsigned stream_type, double dts, double cts);
+/*! \brief
+        Same as mpeg_bitstream_parse, but decodes CC1 - CC4 in one pass. On LIBCAPTION_READY
+        channels->ready holds the channels whose frame is ready to render
+    \param
+*/
+size_t mpeg_bitstream_parse_channels(mpeg_bitstream_t* packet, caption_channels_t* channels, const uint8_t* data, size_t size, unsigned stream_type, double dts, double cts);
 /*! \brief
     \param
 */
 static inline libcaption_stauts_t mpeg_bitstream_status(mpeg_bitstream_t* packet) { return packet->status; }
 /*! \brief
-        Flushes latent packets caused by out or order frames.
-        Returns number of latent frames remaining, 0 when complete;
+        Flushes latent packets caused by out or order frames, and the buffered NALUs.
+        Call at end of stream or at a segment boundary, then parse the next segment as usual.
+        Stops early on LIBCAPTION_READY so every frame can be rendered; keep calling while
+        it returns non zero. Returns number of latent frames remaining, 0 when complete;
     \param
 */
 size_t mpeg_bitstream_flush(mpeg_bitstream_t* packet, caption_frame_t* frame);
+/*! \brief
+        mpeg_bitstream_flush for a stream parsed with mpeg_bitstream_parse_channels
+    \param
+*/
+size_t mpeg_bitstream_flush_channels(mpeg_bitstream_t* packet, caption_channels_t* channels);
 ////////////////////////////////////////////////////////////////////////////////
 typedef enum {
     sei_type_buffering_period = 0,
@@ -107,6 +186,7 @@ typedef struct {
     double timestamp;
     sei_message_t* head;
     sei_message_t* tail;
+    sei_arena_t* arena; // When set, messages are owned by the arena
 } sei_t;
 
 /*! \brief
@@ -114,6 +194,7 @@ typedef struct {
 */
 void sei_init(sei_t* sei, double timestamp);
 /*! \brief
+        Frees all messages. If sei was parsed with sei_parse_arena the arena is reset instead
     \param
 */
 void sei_free(sei_t* sei);
@@ -129,6 +210,14 @@ void sei_message_append(sei_t* sei, sei_message_t* msg);
     \param
 */
 libcaption_stauts_t sei_parse(sei_t* sei, const uint8_t* data, size_t size, double timestamp);
+/*! \brief
+        Same as sei_parse, but messages are allocated from arena.
+        Payloads without emulation prevention bytes reference data directly rather than
+        being copied, so data must remain valid and unmodified until sei_free is called.
+        If itu_t_t35 is set, all other payload types are stepped over without being stored
+    \param
+*/
+libcaption_stauts_t sei_parse_arena(sei_t* sei, sei_arena_t* arena, const uint8_t* data, size_t size, double timestamp, int itu_t_t35);
 /*! \brief
     \param
 */
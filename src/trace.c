@@ -0,0 +1,59 @@
+/**********************************************************************************************/
+/* The MIT License                                                                            */
+/*                                                                                            */
+/* Copyright 2016-2017 Twitch Interactive, Inc. or its affiliates. All Rights Reserved.       */
+/*                                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy               */
+/* of this software and associated documentation files (the "Software"), to deal              */
+/* in the Software without restriction, including without limitation the rights               */
+/* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell                  */
+/* copies of the Software, and to permit persons to whom the Software is                      */
+/* furnished to do so, subject to the following conditions:                                   */
+/*                                                                                            */
+/* The above copyright notice and this permission notice shall be included in                 */
+/* all copies or substantial portions of the Software.                                        */
+/*                                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR                 */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,                   */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE                */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER                     */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,              */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN                  */
+/* THE SOFTWARE.                                                                              */
+/**********************************************************************************************/
+#include "trace.h"
+#include <stdarg.h>
+#include <stdio.h>
+
+#define LIBCAPTION_TRACE_MAX_MESSAGE 256
+
+// Process wide and unsynchronized, see libcaption_trace_set_sink
+static libcaption_trace_sink_t _libcaption_trace_sink = 0;
+static void* _libcaption_trace_opaque = 0;
+
+void libcaption_trace_set_sink(libcaption_trace_sink_t sink, void* opaque)
+{
+    _libcaption_trace_sink = sink;
+    _libcaption_trace_opaque = opaque;
+}
+
+void libcaption_trace(libcaption_trace_category_t category, int level, const char* format, ...)
+{
+    char msg[LIBCAPTION_TRACE_MAX_MESSAGE];
+    va_list args;
+    int size;
+
+    if (!_libcaption_trace_sink) {
+        return;
+    }
+
+    va_start(args, format);
+    size = vsnprintf(msg, sizeof(msg), format, args);
+    va_end(args);
+
+    if (0 > size) {
+        return;
+    }
+
+    _libcaption_trace_sink(_libcaption_trace_opaque, category, level, msg, (size_t)sizeof(msg) <= (size_t)size ? sizeof(msg) - 1 : (size_t)size);
+}
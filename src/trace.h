@@ -0,0 +1,96 @@
+/**********************************************************************************************/
+/* The MIT License                                                                            */
+/*                                                                                            */
+/* Copyright 2016-2017 Twitch Interactive, Inc. or its affiliates. All Rights Reserved.       */
+/*                                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy               */
+/* of this software and associated documentation files (the "Software"), to deal              */
+/* in the Software without restriction, including without limitation the rights               */
+/* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell                  */
+/* copies of the Software, and to permit persons to whom the Software is                      */
+/* furnished to do so, subject to the following conditions:                                   */
+/*                                                                                            */
+/* The above copyright notice and this permission notice shall be included in                 */
+/* all copies or substantial portions of the Software.                                        */
+/*                                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR                 */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,                   */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE                */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER                     */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,              */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN                  */
+/* THE SOFTWARE.                                                                              */
+/**********************************************************************************************/
+#ifndef LIBCAPTION_TRACE_H
+#define LIBCAPTION_TRACE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+////////////////////////////////////////////////////////////////////////////////
+// Compile time tracing. Each category has its own level, selected with
+// -DLIBCAPTION_TRACE_<CATEGORY>_LEVEL=n (or LIBCAPTION_TRACE_LEVEL for all).
+// Trace points above the selected level compile to nothing.
+#define LIBCAPTION_TRACE_OFF 0
+#define LIBCAPTION_TRACE_ERROR 1
+#define LIBCAPTION_TRACE_INFO 2
+#define LIBCAPTION_TRACE_DEBUG 3
+
+#ifndef LIBCAPTION_TRACE_LEVEL
+#define LIBCAPTION_TRACE_LEVEL LIBCAPTION_TRACE_OFF
+#endif
+
+#ifndef LIBCAPTION_TRACE_CAPTION_LEVEL
+#define LIBCAPTION_TRACE_CAPTION_LEVEL LIBCAPTION_TRACE_LEVEL
+#endif
+
+#ifndef LIBCAPTION_TRACE_MPEG_LEVEL
+#define LIBCAPTION_TRACE_MPEG_LEVEL LIBCAPTION_TRACE_LEVEL
+#endif
+
+#ifndef LIBCAPTION_TRACE_TS_LEVEL
+#define LIBCAPTION_TRACE_TS_LEVEL LIBCAPTION_TRACE_LEVEL
+#endif
+
+typedef enum {
+    LIBCAPTION_TRACE_CAPTION = 0, //< eia608 decoding into caption_frame_t
+    LIBCAPTION_TRACE_MPEG = 1, //< bitstream parsing and frame reordering
+    LIBCAPTION_TRACE_TS = 2, //< transport stream sync and demux
+} libcaption_trace_category_t;
+
+/*! \brief Receives formatted trace messages. Called from whichever thread hit the trace point, so it
+        should not block, and must be thread safe if more than one thread decodes
+    \param opaque Value passed to libcaption_trace_set_sink
+    \param category One of libcaption_trace_category_t
+    \param level Level of the trace point
+    \param msg Formatted message, NULL terminated
+    \param size Length of msg in bytes
+*/
+typedef void (*libcaption_trace_sink_t)(void* opaque, libcaption_trace_category_t category, int level, const char* msg, size_t size);
+
+/*! \brief Sets the sink for enabled trace points. Messages are dropped while no sink is set.
+        There is one sink for the whole process, shared by every decoder instance, and setting it
+        is not synchronized with the trace points. Set it before any decoding starts and leave it
+        until all decoding has stopped
+    \param sink Callback, or NULL to drop messages
+    \param opaque Passed to every sink call
+*/
+void libcaption_trace_set_sink(libcaption_trace_sink_t sink, void* opaque);
+/*! \brief Formats a message and hands it to the sink. Use LIBCAPTION_TRACE rather than calling this directly
+    \param
+*/
+void libcaption_trace(libcaption_trace_category_t category, int level, const char* format, ...);
+
+// LIBCAPTION_TRACE(MPEG, DEBUG, "latent=%d\n", latent);
+#define LIBCAPTION_TRACE(CATEGORY, LEVEL, ...)                                                     \
+    do {                                                                                           \
+        if (LIBCAPTION_TRACE_##LEVEL <= LIBCAPTION_TRACE_##CATEGORY##_LEVEL) {                    \
+            libcaption_trace(LIBCAPTION_TRACE_##CATEGORY, LIBCAPTION_TRACE_##LEVEL, __VA_ARGS__); \
+        }                                                                                         \
+    } while (0)
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -22,12 +22,37 @@
 /* THE SOFTWARE.                                                                              */
 /**********************************************************************************************/
 #include "ts.h"
+#include "trace.h"
 #include <stdio.h>
 #include <string.h>
 
+#if defined(__GNUC__)
+#define _ts_ctz(x) __builtin_ctz(x)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+static inline unsigned _ts_ctz(unsigned long x)
+{
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (unsigned)i;
+}
+#endif
+
+#if (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && 2 <= _M_IX86_FP)) && defined(_ts_ctz)
+#include <emmintrin.h>
+#define TS_SIMD_SSE2
+#endif
+
+#define TS_SYNC_BYTE 0x47
+// Header bits kept in ts_batch_t flags, at their position in byte 1 and byte 3 of the packet
+#define TS_FLAG_PUSI 0x40
+#define TS_FLAG_ADAPTION 0x20
+#define TS_FLAG_PAYLOAD 0x10
+
 void ts_init(ts_t* ts)
 {
     memset(ts, 0, sizeof(ts_t));
+    ts->pid[0].type = ts_pid_pat;
 }
 
 static int64_t ts_parse_pts(const uint8_t* data)
@@ -42,78 +67,363 @@ static int64_t ts_parse_pts(const uint8_t* data)
     return pts;
 }
 
-int ts_parse_packet(ts_t* ts, const uint8_t* data)
+#define TS_TABLE_PAT 0x00
+#define TS_TABLE_PMT 0x02
+
+// Returns the offset of the section after the pointer field, or 0 if it is not table_id or does not fit
+// in the packet. Sections that continue into the next packet are not reassembled, they are skipped whole
+static size_t ts_section_start(const uint8_t* data, size_t i, int pusi, uint8_t table_id, size_t* end)
 {
-    size_t i = 0;
-    int pusi = !!(data[i + 1] & 0x40); // Payload Unit Start Indicator
-    int16_t pid = ((data[i + 1] & 0x1F) << 8) | data[i + 2]; // PID
-    int adaption_present = !!(data[i + 3] & 0x20); // Adaptation field exist
-    int payload_present = !!(data[i + 3] & 0x10); // Contains payload
-    i += 4;
+    if (!pusi || TS_PACKET_SIZE <= i + 1 + data[i] + 3) {
+        return 0;
+    }
 
-    ts->data = 0;
-    ts->size = 0;
+    i += 1 + data[i];
+    size_t section_length = ((data[i + 1] & 0x0F) << 8) | data[i + 2];
 
-    if (adaption_present) {
-        uint8_t adaption_length = data[i + 0]; // adaption field length
-        i += 1 + adaption_length;
+    if (table_id != data[i]) {
+        return 0;
     }
 
-    if (pid == 0) {
-        if (payload_present) {
-            // Skip the payload.
-            i += data[i] + 1;
+    if (TS_PACKET_SIZE < i + 3 + section_length) {
+        LIBCAPTION_TRACE(TS, INFO, "skipped table 0x%02X section of %d bytes spanning packets\n", table_id, (int)section_length);
+        return 0;
+    }
+
+    (*end) = i + 3 + section_length - 4; // 4 for the crc
+    return i;
+}
+
+static void ts_parse_pat(ts_t* ts, const uint8_t* data, size_t i, size_t end)
+{
+    int p;
+
+    for (i += 8; i + 4 <= end; i += 4) {
+        uint16_t program_number = (data[i + 0] << 8) | data[i + 1];
+        int16_t pmtpid = ((data[i + 2] & 0x1F) << 8) | data[i + 3];
+
+        // program 0 is the network PID
+        if (!program_number) {
+            continue;
         }
 
-        ts->pmtpid = ((data[i + 10] & 0x1F) << 8) | data[i + 11];
-    } else if (pid == ts->pmtpid) {
-        // PMT
-        if (payload_present) {
-            // Skip the payload.
-            i += data[i] + 1;
+        for (p = 0; p < ts->programs && ts->program[p].program_number != program_number; ++p) {
         }
 
-        uint16_t section_length = ((data[i + 1] & 0x0F) << 8) | data[i + 2];
-        int current = data[i + 5] & 0x01;
-        int16_t program_info_length = ((data[i + 10] & 0x0F) << 8) | data[i + 11];
-        int16_t descriptor_loop_length = section_length - (9 + program_info_length + 4); // 4 for the crc
+        if (p == ts->programs) {
+            if (TS_MAX_PROGRAMS == ts->programs) {
+                continue;
+            }
 
-        i += 12 + program_info_length;
+            ++ts->programs;
+        }
 
-        if (current) {
-            while (descriptor_loop_length >= 5) {
-                uint8_t stream_type = data[i];
-                int16_t elementary_pid = ((data[i + 1] & 0x1F) << 8) | data[i + 2];
-                int16_t esinfo_length = ((data[i + 3] & 0x0F) << 8) | data[i + 4];
+        // Program moved to a new PMT PID, stop routing the old one
+        ts_pid_t* old = &ts->pid[ts->program[p].pmtpid];
+        if (ts->program[p].pmtpid != pmtpid && ts_pid_pmt == old->type && p == old->index) {
+            old->type = ts_pid_none;
+        }
 
-                if (STREAM_TYPE_H262 == stream_type || STREAM_TYPE_H264 == stream_type || STREAM_TYPE_H265 == stream_type) {
-                    ts->ccpid = elementary_pid;
-                    ts->stream_type = stream_type;
-                }
+        // Don't let a PMT take over the PAT, or a PID already routed elsewhere
+        if (ts_pid_none == ts->pid[pmtpid].type) {
+            ts->pid[pmtpid].type = ts_pid_pmt;
+            ts->pid[pmtpid].index = p;
+        }
+
+        ts->program[p].program_number = program_number;
+        ts->program[p].pmtpid = pmtpid;
+    }
+
+    if (ts->programs) {
+        ts->pmtpid = ts->program[0].pmtpid;
+    }
+}
+
+static void ts_parse_pmt(ts_t* ts, const uint8_t* data, size_t i, size_t end)
+{
+    int s;
+    if (end < i + 12 || !(data[i + 5] & 0x01)) {
+        return; // truncated, or not yet current
+    }
+
+    uint16_t program_number = (data[i + 3] << 8) | data[i + 4];
+    int16_t program_info_length = ((data[i + 10] & 0x0F) << 8) | data[i + 11];
+
+    for (i += 12 + program_info_length; i + 5 <= end;) {
+        uint8_t stream_type = data[i];
+        int16_t elementary_pid = ((data[i + 1] & 0x1F) << 8) | data[i + 2];
+        int16_t esinfo_length = ((data[i + 3] & 0x0F) << 8) | data[i + 4];
+
+        if (STREAM_TYPE_H262 == stream_type || STREAM_TYPE_H264 == stream_type || STREAM_TYPE_H265 == stream_type) {
+            for (s = 0; s < ts->streams && ts->stream[s].pid != elementary_pid; ++s) {
+            }
+
+            if (s == ts->streams && TS_MAX_STREAMS > ts->streams) {
+                memset(&ts->stream[s], 0, sizeof(ts_stream_t));
+                ++ts->streams;
+            }
+
+            if (s < ts->streams && ts_pid_none == ts->pid[elementary_pid].type) {
+                ts->pid[elementary_pid].type = ts_pid_pes;
+                ts->pid[elementary_pid].index = s;
+            }
 
-                i += 5 + esinfo_length;
-                descriptor_loop_length -= 5 + esinfo_length;
+            if (s < ts->streams) {
+                ts->stream[s].program_number = program_number;
+                ts->stream[s].pid = elementary_pid;
+                ts->stream[s].stream_type = stream_type;
             }
+
+            ts->ccpid = elementary_pid;
+        }
+
+        i += 5 + esinfo_length;
+    }
+}
+
+static int ts_parse_payload(ts_t* ts, const uint8_t* data, ts_pid_t route, uint8_t flags)
+{
+    size_t i = 4, end;
+    int pusi = !!(flags & TS_FLAG_PUSI); // Payload Unit Start Indicator
+    int adaption_present = !!(flags & TS_FLAG_ADAPTION); // Adaptation field exist
+    int payload_present = !!(flags & TS_FLAG_PAYLOAD); // Contains payload
+
+    // Most of a full mux is PIDs we don't care about, drop them on the header alone
+    if (ts_pid_none == route.type || !payload_present) {
+        return LIBCAPTION_OK;
+    }
+
+    if (adaption_present) {
+        uint8_t adaption_length = data[i + 0]; // adaption field length
+        i += 1 + adaption_length;
+    }
+
+    if (TS_PACKET_SIZE <= i) {
+        return LIBCAPTION_OK;
+    }
+
+    switch (route.type) {
+    case ts_pid_pat:
+        if ((i = ts_section_start(data, i, pusi, TS_TABLE_PAT, &end))) {
+            ts_parse_pat(ts, data, i, end);
         }
-    } else if (payload_present && pid == ts->ccpid) {
+        break;
+
+    case ts_pid_pmt:
+        if ((i = ts_section_start(data, i, pusi, TS_TABLE_PMT, &end))) {
+            ts_parse_pmt(ts, data, i, end);
+        }
+        break;
+
+    case ts_pid_pes: {
+        ts_stream_t* stream = &ts->stream[route.index];
+
         if (pusi) {
+            if (TS_PACKET_SIZE < i + 9 || TS_PACKET_SIZE < i + 9 + data[i + 8]) {
+                return LIBCAPTION_OK;
+            }
+
             // int data_alignment = !! (data[i + 6] & 0x04);
             int has_pts = !!(data[i + 7] & 0x80);
             int has_dts = !!(data[i + 7] & 0x40);
             uint8_t header_length = data[i + 8];
 
-            if (has_pts) {
-                ts->pts = ts_parse_pts(&data[i + 9]);
-                ts->dts = has_dts ? ts_parse_pts(&data[i + 14]) : ts->pts;
+            // The timestamps must fit in the header, which was checked to fit in the packet above
+            if (has_pts && header_length >= (has_dts ? 10 : 5)) {
+                stream->pts = ts_parse_pts(&data[i + 9]);
+                stream->dts = has_dts ? ts_parse_pts(&data[i + 14]) : stream->pts;
             }
 
             i += 9 + header_length;
         }
 
+        ts->current = route.index;
+        ts->stream_type = stream->stream_type;
+        ts->pts = stream->pts;
+        ts->dts = stream->dts;
         ts->data = &data[i];
         ts->size = TS_PACKET_SIZE - i;
         return LIBCAPTION_READY;
     }
+    }
 
     return LIBCAPTION_OK;
 }
+
+int ts_parse_packet(ts_t* ts, const uint8_t* data)
+{
+    int16_t pid = ((data[1] & 0x1F) << 8) | data[2]; // PID
+    uint8_t flags = (data[1] & TS_FLAG_PUSI) | (data[3] & (TS_FLAG_ADAPTION | TS_FLAG_PAYLOAD));
+
+    ts->data = 0;
+    ts->size = 0;
+
+    if (TS_SYNC_BYTE != data[0]) {
+        return LIBCAPTION_ERROR;
+    }
+
+    return ts_parse_payload(ts, data, ts->pid[pid], flags);
+}
+
+// Returns the offset of the first sync byte at or after from, or size if there is none
+static size_t ts_find_sync(const uint8_t* data, size_t size, size_t from)
+{
+    size_t i = from;
+
+#if defined(TS_SIMD_SSE2)
+    const __m128i mark = _mm_set1_epi8(TS_SYNC_BYTE);
+
+    for (; i + 32 <= size; i += 32) {
+        unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&data[i + 0]), mark))
+            | ((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&data[i + 16]), mark)) << 16);
+
+        if (m) {
+            return i + _ts_ctz(m);
+        }
+    }
+#endif
+
+    for (; i < size && TS_SYNC_BYTE != data[i]; ++i) {
+    }
+
+    return i;
+}
+
+static const size_t ts_packet_sizes[] = { 188, 192, 204 };
+#define TS_PACKET_SIZES (sizeof(ts_packet_sizes) / sizeof(ts_packet_sizes[0]))
+
+// Returns 1 if TS_SYNC_LOCK packets of packet_size line up from i, 0 if not, -1 if data ends first
+static int ts_sync_run(const uint8_t* data, size_t size, size_t i, size_t packet_size)
+{
+    int k;
+
+    for (k = 1; k < TS_SYNC_LOCK; ++k, i += packet_size) {
+        if (size <= i + packet_size) {
+            return -1;
+        }
+
+        if (TS_SYNC_BYTE != data[i + packet_size]) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Returns the offset of the next run of sync bytes and sets ts->packet_size to its stride.
+// Otherwise returns the first candidate data ended too soon to rule out, or size
+static size_t ts_resync(ts_t* ts, const uint8_t* data, size_t size, int* locked)
+{
+    size_t i, p, candidate[1 + TS_PACKET_SIZES];
+    int run, more;
+
+    // The size we were last locked on is the most likely, try it first
+    candidate[0] = ts->packet_size ? ts->packet_size : ts_packet_sizes[0];
+    for (p = 0; p < TS_PACKET_SIZES; ++p) {
+        candidate[1 + p] = ts_packet_sizes[p];
+    }
+
+    for (i = ts_find_sync(data, size, 0); i < size; i = ts_find_sync(data, size, i + 1)) {
+        for (more = 0, p = 0; p <= TS_PACKET_SIZES; ++p) {
+            if (1 == (run = ts_sync_run(data, size, i, candidate[p]))) {
+                if (ts->packet_size && ts->packet_size != candidate[p]) {
+                    LIBCAPTION_TRACE(TS, INFO, "packet size changed from %d to %d\n", (int)ts->packet_size, (int)candidate[p]);
+                }
+
+                ts->packet_size = candidate[p];
+                (*locked) = 1;
+                return i;
+            }
+
+            more |= run < 0;
+        }
+
+        if (more) {
+            break;
+        }
+    }
+
+    (*locked) = 0;
+    return i;
+}
+
+static void ts_batch_load(ts_batch_t* batch, const uint8_t* data, size_t packets, size_t packet_size)
+{
+    int k, count = TS_BATCH_PACKETS < packets ? TS_BATCH_PACKETS : (int)packets;
+
+    // End the batch at the first bad sync byte
+    for (k = 0; k < count && TS_SYNC_BYTE == data[k * packet_size]; ++k) {
+        const uint8_t* pkt = &data[k * packet_size];
+        batch->pid[k] = ((pkt[1] & 0x1F) << 8) | pkt[2];
+        batch->flags[k] = (pkt[1] & TS_FLAG_PUSI) | (pkt[3] & (TS_FLAG_ADAPTION | TS_FLAG_PAYLOAD));
+    }
+
+    batch->data = data;
+    batch->next = 0;
+    batch->count = k;
+}
+
+size_t ts_parse_packets(ts_t* ts, const uint8_t* data, size_t size)
+{
+    ts_batch_t* batch = &ts->batch;
+    const uint8_t* start = data;
+    const uint8_t* end = data + size;
+    size_t skip;
+
+    ts->data = 0;
+    ts->size = 0;
+    ts->status = LIBCAPTION_OK;
+
+    // Rest of the packet that ended the last buffer, the next M2TS prefix or the Reed-Solomon parity
+    skip = ts->skip < size ? ts->skip : size;
+    data += skip, ts->skip -= skip;
+
+    // Pick up where the last call stopped if it is the same buffer
+    if (batch->data && (data != &batch->data[batch->next * ts->packet_size] || batch->next >= batch->count)) {
+        batch->data = 0;
+    }
+
+    while (TS_PACKET_SIZE <= end - data) {
+        if (!batch->data) {
+            // A sync byte left at the front by a call that could not confirm it is checked again
+            if (!ts->locked || TS_SYNC_BYTE != data[0]) {
+                size_t offset = ts_resync(ts, data, end - data, &ts->locked);
+
+                if (offset) {
+                    LIBCAPTION_TRACE(TS, INFO, "skipped %d bytes looking for sync\n", (int)offset);
+                }
+
+                data += offset;
+
+                if (!ts->locked) {
+                    break;
+                }
+            }
+
+            // Count the packets that have all 188 bytes, the last one may be missing its tail
+            ts_batch_load(batch, data, 1 + (end - data - TS_PACKET_SIZE) / ts->packet_size, ts->packet_size);
+        }
+
+        while (batch->next < batch->count && TS_PACKET_SIZE <= end - data) {
+            int k = batch->next++;
+            ts_pid_t route = ts->pid[batch->pid[k]];
+            const uint8_t* pkt = data;
+
+            if (ts->packet_size <= (size_t)(end - data)) {
+                data += ts->packet_size;
+            } else {
+                ts->skip = ts->packet_size - (end - data);
+                data = end;
+            }
+
+            if (ts_pid_none != route.type && LIBCAPTION_READY == ts_parse_payload(ts, pkt, route, batch->flags[k])) {
+                ts->status = LIBCAPTION_READY;
+                return data - start;
+            }
+        }
+
+        batch->data = 0;
+    }
+
+    return data - start;
+}
@@ -26,24 +26,95 @@
 #include "caption.h"
 #include "mpeg.h"
 
+#define TS_MAX_PROGRAMS 64
+#define TS_MAX_STREAMS 64
+#define TS_MAX_PIDS 8192
+#define TS_BATCH_PACKETS 64
+// Sync bytes in a row at the same stride needed to lock on to a packet size
+#define TS_SYNC_LOCK 3
+
+typedef enum {
+    ts_pid_none = 0,
+    ts_pid_pat,
+    ts_pid_pmt,
+    ts_pid_pes,
+} ts_pid_type_t;
+
+// Routes a PID to its handler, index is into program for pmt and stream for pes
+typedef struct {
+    uint8_t type;
+    uint8_t index;
+} ts_pid_t;
+
 typedef struct {
+    uint16_t program_number;
     int16_t pmtpid;
-    int16_t ccpid;
+} ts_program_t;
+
+// Video elementary streams that may carry captions
+typedef struct {
+    uint16_t program_number;
+    int16_t pid;
+    int16_t stream_type;
+    int64_t pts;
+    int64_t dts;
+} ts_stream_t;
+
+// Headers of the packets in the current ts_parse_packets batch, unpacked one array per field
+typedef struct {
+    const uint8_t* data; //< first packet of the batch
+    int count; //< packets with a valid sync byte
+    int next; //< next packet to hand to its PID handler
+    uint16_t pid[TS_BATCH_PACKETS];
+    uint8_t flags[TS_BATCH_PACKETS];
+} ts_batch_t;
+
+typedef struct {
+    int16_t pmtpid; //< of the first program
+    int16_t ccpid; //< last video pid found in a PMT
     int16_t stream_type;
     int64_t pts;
     int64_t dts;
     size_t size;
     const uint8_t* data;
+    int current; //< index into stream of the packet data belongs to
+    int programs;
+    ts_program_t program[TS_MAX_PROGRAMS];
+    int streams;
+    ts_stream_t stream[TS_MAX_STREAMS];
+    ts_pid_t pid[TS_MAX_PIDS];
+    size_t packet_size; //< 188, 192 (M2TS) or 204 (Reed-Solomon), 0 until locked
+    int locked; //< 0 until TS_SYNC_LOCK packets of packet_size line up, and again after sync is lost
+    size_t skip; //< bytes after the last packet still to skip, when it ended the buffer
+    libcaption_stauts_t status;
+    ts_batch_t batch;
 } ts_t;
 
 /*! \brief
     \param
 
-    Expects 188 byte TS packet
+    Expects 188 byte TS packet, starting at its sync byte. Returns LIBCAPTION_ERROR without
+    a sync byte. Every program in the PAT is tracked, and every video stream
+    in their PMTs. Returns LIBCAPTION_READY with data, size, pts, dts and stream_type set for
+    the video packet, and current set to its index in stream, so each stream can be given its own
+    mpeg_bitstream_t.
 */
 #define TS_PACKET_SIZE 188
 void ts_init(ts_t* ts);
 int ts_parse_packet(ts_t* ts, const uint8_t* data);
+/*! \brief
+        Parses as many whole packets from data as possible. The packet size (188, 192 byte M2TS
+        with a timestamp prefix, or 204 byte with Reed-Solomon parity) is detected from the
+        spacing of sync bytes, and lost sync is recovered by skipping ahead to the next run of
+        them. Sync bytes and headers are checked a batch at a time, and only packets on a known
+        PID reach their handler. Returns the number of bytes consumed. Stops after a video packet
+        with status LIBCAPTION_READY, with data and size set as for ts_parse_packet; call again
+        with the remainder of the same buffer to continue. Status LIBCAPTION_OK means the rest
+        of data is too short to parse, keep it and append more before calling again.
+    \param
+*/
+size_t ts_parse_packets(ts_t* ts, const uint8_t* data, size_t size);
+static inline libcaption_stauts_t ts_status(ts_t* ts) { return ts->status; }
 // return timestamp in seconds
 static inline double ts_dts_seconds(ts_t* ts) { return ts->dts / 90000.0; }
 static inline double ts_pts_seconds(ts_t* ts) { return ts->pts / 90000.0; }
@@ -21,44 +21,254 @@
 /* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN                  */
 /* THE SOFTWARE.                                                                              */
 /**********************************************************************************************/
+// mmap, madvise and posix_memalign are hidden by glibc in strict C99 mode
+#if !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
 #include "ts.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TS2SRT_MMAP
+#endif
+
+// Build with -DTS2SRT_HUGE_PAGES to ask for transparent huge pages on the input. Cuts TLB
+// misses on very large files, but file mappings only get them if the kernel supports it
+#define INPUT_BLOCK_SIZE (8192 * TS_PACKET_SIZE)
+#if defined(TS2SRT_HUGE_PAGES)
+#define INPUT_BLOCK_ALIGN (2 * 1024 * 1024)
+#else
+#define INPUT_BLOCK_ALIGN 4096
+#endif
+
+// The whole file mapped in place when we can, otherwise a block refilled with read(), for pipes
+typedef struct {
+#if defined(TS2SRT_MMAP)
+    int fd;
+#else
+    FILE* file;
+#endif
+    uint8_t* map;
+    size_t map_size;
+    uint8_t* block;
+    size_t size; //< bytes in block
+} input_t;
+
+static void input_close(input_t* input)
+{
+#if defined(TS2SRT_MMAP)
+    if (input->map) {
+        munmap(input->map, input->map_size);
+    }
+
+    if (0 <= input->fd && STDIN_FILENO != input->fd) {
+        close(input->fd);
+    }
+#else
+    if (input->file && stdin != input->file) {
+        fclose(input->file);
+    }
+#endif
+
+    free(input->block);
+}
+
+static int input_open(input_t* input, const char* path)
+{
+    memset(input, 0, sizeof(input_t));
+#if defined(TS2SRT_MMAP)
+    struct stat st;
+
+    if (0 > (input->fd = strcmp(path, "-") ? open(path, O_RDONLY) : STDIN_FILENO)) {
+        return 0;
+    }
+
+    if (0 == fstat(input->fd, &st) && S_ISREG(st.st_mode) && 0 < st.st_size && (uint64_t)st.st_size <= SIZE_MAX) {
+        void* map = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, input->fd, 0);
+
+        if (MAP_FAILED != map) {
+            input->map = (uint8_t*)map;
+            input->map_size = (size_t)st.st_size;
+            madvise(map, input->map_size, MADV_SEQUENTIAL);
+#if defined(TS2SRT_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+            madvise(map, input->map_size, MADV_HUGEPAGE);
+#endif
+            return 1;
+        }
+    }
+
+    // Not a regular file, or too big to map on this platform
+    if (posix_memalign((void**)&input->block, INPUT_BLOCK_ALIGN, INPUT_BLOCK_SIZE)) {
+        input->block = 0;
+        return 0;
+    }
+
+#if defined(TS2SRT_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+    madvise(input->block, INPUT_BLOCK_SIZE, MADV_HUGEPAGE);
+#endif
+#else
+    if (!(input->file = strcmp(path, "-") ? fopen(path, "rb") : stdin)) {
+        return 0;
+    }
+
+    // Reads are already in large blocks, skip the copy through the stdio buffer
+    setvbuf(input->file, 0, _IONBF, 0);
+    input->block = (uint8_t*)malloc(INPUT_BLOCK_SIZE);
+#endif
+
+    return 0 != input->block;
+}
+
+// Points data at the next bytes of input, beginning with the last unused bytes of the previous call.
+// Returns how many, or 0 once there is no new input
+static size_t input_read(input_t* input, const uint8_t** data, size_t unused)
+{
+    size_t size;
+
+    if (input->map) {
+        (*data) = input->map;
+        size = input->size ? 0 : input->map_size;
+        input->size = input->map_size;
+        return size;
+    }
+
+    memmove(&input->block[0], &input->block[input->size - unused], unused);
+    size = input->size = unused;
+
+    // Pipes return short reads, fill the block so batches stay large
+    while (input->size < INPUT_BLOCK_SIZE) {
+#if defined(TS2SRT_MMAP)
+        ssize_t bytes = read(input->fd, &input->block[input->size], INPUT_BLOCK_SIZE - input->size);
+
+        if (0 > bytes && EINTR == errno) {
+            continue;
+        }
+
+        if (0 >= bytes) {
+            break;
+        }
+#else
+        size_t bytes = fread(&input->block[input->size], 1, INPUT_BLOCK_SIZE - input->size, input->file);
+
+        if (!bytes) {
+            break;
+        }
+#endif
+
+        input->size += bytes;
+    }
+
+    (*data) = &input->block[0];
+    return size < input->size ? input->size : 0;
+}
+
+// Each video stream in the mux gets its own bitstream and caption state
+typedef struct {
+    int16_t pid;
+    mpeg_bitstream_t mpegbs;
+    caption_channels_t channels;
+    dtvcc_t dtvcc;
+} decoder_t;
+
+static decoder_t* decoder_new(int16_t pid)
+{
+    decoder_t* decoder = (decoder_t*)malloc(sizeof(decoder_t));
+
+    if (decoder) {
+        decoder->pid = pid;
+        mpeg_bitstream_init(&decoder->mpegbs);
+        caption_channels_init(&decoder->channels);
+        dtvcc_init(&decoder->dtvcc);
+        decoder->channels.dtvcc = &decoder->dtvcc;
+    }
+
+    return decoder;
+}
+
+static void decoder_free(decoder_t* decoder)
+{
+    if (decoder) {
+        mpeg_bitstream_free(&decoder->mpegbs);
+        dtvcc_free(&decoder->dtvcc);
+        free(decoder);
+    }
+}
+
+static void print_ready(decoder_t* decoder, char* data)
+{
+    int i;
+    caption_channels_t* channels = &decoder->channels;
+
+    for (i = 0; i < CAPTION_CHANNELS; ++i) {
+        if (channels->ready & (1 << i)) {
+            printf("-------------------------------\n");
+            caption_frame_to_text(&channels->frame[i], data);
+            printf("PID %d CC%d data:\n%s\n", decoder->pid, i + 1, data);
+        }
+    }
+
+    for (i = 1; channels->dtvcc && i < DTVCC_MAX_SERVICES; ++i) {
+        if (channels->dtvcc->ready & ((uint64_t)1 << i)) {
+            printf("-------------------------------\n");
+            dtvcc_service_to_text(dtvcc_service(channels->dtvcc, i), data);
+            printf("PID %d SERVICE%d data:\n%s\n", decoder->pid, i, data);
+        }
+    }
+}
+
 int main(int argc, char** argv)
 {
-    //const char* path = argv[1];
-   
-    char mydata[2048];
+    const char* path = 1 < argc ? argv[1] : "./cc_minimum.ts";
 
+    char mydata[DTVCC_SERVICE_TEXT_BYTES];
+
+    int i;
     ts_t ts;
-    mpeg_bitstream_t mpegbs;
-    caption_frame_t frame;
-    uint8_t pkt[TS_PACKET_SIZE];
+    decoder_t* decoder[TS_MAX_STREAMS] = { 0 };
+    input_t input;
+    const uint8_t* data;
+    size_t size = 0;
     ts_init(&ts);
-    caption_frame_init(&frame);
-    mpeg_bitstream_init(&mpegbs);
 
     //srt = vtt_new();
-    FILE* file = fopen("./cc_minimum.ts", "rb");
-    if(!file) {
+    if (!input_open(&input, path)) {
         printf("Failed to open input\n");
+        input_close(&input);
         return EXIT_FAILURE;
     }
 
-    setvbuf(file, 0, _IOFBF, 8192 * TS_PACKET_SIZE);
-    while (TS_PACKET_SIZE == fread(&pkt[0], 1, TS_PACKET_SIZE, file)) {
+    // Packets are parsed in place, straight out of the mapping or read block
+    while (0 < (size = input_read(&input, &data, size))) {
+        for (;;) {
+            size_t bytes_parsed = ts_parse_packets(&ts, data, size);
+            data += bytes_parsed, size -= bytes_parsed;
+
+            if (LIBCAPTION_READY != ts_status(&ts)) {
+                break;
+            }
 
-        if (LIBCAPTION_READY == ts_parse_packet(&ts, &pkt[0])) {
             double dts = ts_dts_seconds(&ts);
             double cts = ts_cts_seconds(&ts);
+            decoder_t* dec = decoder[ts.current];
+
+            if (!dec && !(dec = decoder[ts.current] = decoder_new(ts.stream[ts.current].pid))) {
+                return EXIT_FAILURE;
+            }
+
             while (ts.size) {
 
-                size_t bytes_read = mpeg_bitstream_parse(&pkt[0], &mpegbs, &frame, ts.data, ts.size, STREAM_TYPE_H264, dts, cts);
+                size_t bytes_read = mpeg_bitstream_parse_channels(&dec->mpegbs, &dec->channels, ts.data, ts.size, ts.stream_type, dts, cts);
                 ts.data += bytes_read, ts.size -= bytes_read;
 
-                switch (mpegbs.status) {
+                switch (dec->mpegbs.status) {
                 default:
                     return EXIT_FAILURE;
                     break;
@@ -67,19 +277,34 @@ int main(int argc, char** argv)
                     break;
 
                 case LIBCAPTION_READY: {
-                	printf("-------------------------------\n");
-                    caption_frame_to_text(&frame, mydata);
-                    printf("data:\n%s\n",mydata);
-
+                    print_ready(dec, mydata);
                 } break;
                 } //switch
             } // while
-        } // if
+        } // for
     } // while
 
-    printf("------------------------------------------------------------\n");
+    // Drain captions still waiting on reordering
+    for (i = 0; i < TS_MAX_STREAMS; ++i) {
+        decoder_t* dec = decoder[i];
+
+        while (dec) {
+            size_t latent = mpeg_bitstream_flush_channels(&dec->mpegbs, &dec->channels);
 
+            if (LIBCAPTION_READY == mpeg_bitstream_status(&dec->mpegbs)) {
+                print_ready(dec, mydata);
+            }
 
+            if (!latent || LIBCAPTION_ERROR == mpeg_bitstream_status(&dec->mpegbs)) {
+                break;
+            }
+        }
+
+        decoder_free(dec);
+    }
+
+    printf("------------------------------------------------------------\n");
+    input_close(&input);
 
     return EXIT_SUCCESS;
 }
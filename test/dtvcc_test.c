@@ -0,0 +1,257 @@
+/**********************************************************************************************/
+/* The MIT License                                                                            */
+/*                                                                                            */
+/* Copyright 2016-2017 Twitch Interactive, Inc. or its affiliates. All Rights Reserved.       */
+/*                                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy               */
+/* of this software and associated documentation files (the "Software"), to deal              */
+/* in the Software without restriction, including without limitation the rights               */
+/* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell                  */
+/* copies of the Software, and to permit persons to whom the Software is                      */
+/* furnished to do so, subject to the following conditions:                                   */
+/*                                                                                            */
+/* The above copyright notice and this permission notice shall be included in                 */
+/* all copies or substantial portions of the Software.                                        */
+/*                                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR                 */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,                   */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE                */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER                     */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,              */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN                  */
+/* THE SOFTWARE.                                                                              */
+/**********************************************************************************************/
+// Checks for the CEA-708 service and window decoder in dtvcc.c. Build from the repo root with
+//
+//     cc -Isrc -o dtvcc_test test/dtvcc_test.c src/dtvcc.c src/trace.c src/utf8.c
+//
+// and run ./dtvcc_test, it returns non zero if a check failed.
+
+#include "dtvcc.h"
+#include "test.h"
+#include <string.h>
+
+// Builds one caption channel packet from service blocks
+typedef struct {
+    uint8_t data[DTVCC_PACKET_SIZE];
+    size_t size;
+} test_packet_t;
+
+static void test_packet_init(test_packet_t* packet)
+{
+    memset(packet, 0, sizeof(test_packet_t));
+    packet->size = 1; // packet header, written by test_packet_send
+}
+
+// Appends a service block, services 7 - 63 use the extended header
+static void test_packet_block(test_packet_t* packet, int service, const char* block, size_t size)
+{
+    if (7 > service) {
+        packet->data[packet->size++] = (uint8_t)(service << 5 | size);
+    } else {
+        packet->data[packet->size++] = (uint8_t)(7 << 5 | size);
+        packet->data[packet->size++] = (uint8_t)service;
+    }
+
+    memcpy(&packet->data[packet->size], block, size);
+    packet->size += size;
+}
+
+// Sends the packet as cc_data pairs, the decoder parses it once the last pair arrives
+static libcaption_stauts_t test_packet_send(dtvcc_t* dtvcc, test_packet_t* packet, double timestamp)
+{
+    libcaption_stauts_t status = LIBCAPTION_OK;
+    size_t size = (packet->size + 1) & ~(size_t)1;
+    static int sequence = 0;
+
+    packet->data[0] = (uint8_t)((sequence++ & 3) << 6 | (size / 2 & 0x3F));
+
+    for (size_t i = 0; i < size; i += 2) {
+        status = libcaption_status_update(status, dtvcc_decode(dtvcc, 0 == i, (uint16_t)(packet->data[i] << 8 | packet->data[i + 1]), timestamp));
+    }
+
+    return status;
+}
+
+// One packet holding one block
+static libcaption_stauts_t test_send_block(dtvcc_t* dtvcc, int service, const char* block, size_t size)
+{
+    test_packet_t packet;
+    test_packet_init(&packet);
+    test_packet_block(&packet, service, block, size);
+    return test_packet_send(dtvcc, &packet, 0);
+}
+
+#define TEST_BLOCK(DTVCC, SERVICE, BLOCK) test_send_block(DTVCC, SERVICE, BLOCK, sizeof(BLOCK) - 1)
+
+static int test_text_is(dtvcc_t* dtvcc, int service, const char* expected)
+{
+    utf8_char_t text[DTVCC_SERVICE_TEXT_BYTES];
+    dtvcc_service_t* s = dtvcc_service(dtvcc, service);
+
+    if (!s) {
+        fprintf(stderr, "service %d: not decoded\n", service);
+        return 0;
+    }
+
+    dtvcc_service_to_text(s, text);
+
+    if (strcmp(text, expected)) {
+        fprintf(stderr, "service %d: \"%s\", expected \"%s\"\n", service, text, expected);
+        return 0;
+    }
+
+    return 1;
+}
+
+// DefineWindow0, visible, priority 0, 2 rows of 10 columns
+#define TEST_DF0 "\x98\x20\x00\x00\x01\x09\x00"
+
+// One block defines a window and writes to it, each packet marks its service ready
+static void test_service_blocks()
+{
+    dtvcc_t dtvcc;
+    test_packet_t packet;
+
+    dtvcc_init(&dtvcc);
+    TEST_CHECK(LIBCAPTION_READY == TEST_BLOCK(&dtvcc, 1, TEST_DF0 "HELLO"));
+    TEST_CHECK(((uint64_t)1 << 1) == dtvcc.ready);
+    TEST_CHECK(test_text_is(&dtvcc, 1, "HELLO"));
+    TEST_CHECK(0 == dtvcc_service(&dtvcc, 2));
+
+    // Two services in one packet, a null block ends it
+    test_packet_init(&packet);
+    test_packet_block(&packet, 2, TEST_DF0 "TWO", 10);
+    test_packet_block(&packet, 3, TEST_DF0 "THREE", 12);
+    test_packet_block(&packet, 0, "", 0);
+    test_packet_block(&packet, 4, TEST_DF0 "FOUR", 11);
+    dtvcc.ready = 0;
+    TEST_CHECK(LIBCAPTION_READY == test_packet_send(&dtvcc, &packet, 0));
+    TEST_CHECK(((uint64_t)1 << 2 | (uint64_t)1 << 3) == dtvcc.ready);
+    TEST_CHECK(test_text_is(&dtvcc, 1, "HELLO"));
+    TEST_CHECK(test_text_is(&dtvcc, 2, "TWO"));
+    TEST_CHECK(test_text_is(&dtvcc, 3, "THREE"));
+    TEST_CHECK(0 == dtvcc_service(&dtvcc, 4));
+
+    // Packet data before any packet start is ignored
+    dtvcc_free(&dtvcc);
+    TEST_CHECK(LIBCAPTION_OK == dtvcc_decode(&dtvcc, 0, 0x2141, 0));
+    TEST_CHECK(0 == dtvcc_service(&dtvcc, 1));
+
+    dtvcc_free(&dtvcc);
+}
+
+// Text goes to the current window, only visible windows are rendered, highest priority first
+static void test_windows()
+{
+    dtvcc_t dtvcc;
+
+    dtvcc_init(&dtvcc);
+    // Window 1 priority 1, window 0 hidden with priority 0
+    TEST_BLOCK(&dtvcc, 1, "\x99\x21\x00\x00\x00\x09\x00" "ONE" "\x98\x00\x00\x00\x00\x09\x00" "ZERO");
+    TEST_CHECK(test_text_is(&dtvcc, 1, "ONE"));
+
+    // DisplayWindows 0, now it comes first
+    TEST_BLOCK(&dtvcc, 1, "\x89\x01");
+    TEST_CHECK(test_text_is(&dtvcc, 1, "ZERO\nONE"));
+
+    // SetCurrentWindow1 then more text, ToggleWindows hides both then shows 0 again
+    TEST_BLOCK(&dtvcc, 1, "\x81" "!" "\x8B\x03");
+    TEST_CHECK(test_text_is(&dtvcc, 1, ""));
+    TEST_BLOCK(&dtvcc, 1, "\x8B\x02");
+    TEST_CHECK(test_text_is(&dtvcc, 1, "ONE!"));
+
+    // ClearWindows keeps the window, DeleteWindows drops it and its current window
+    TEST_BLOCK(&dtvcc, 1, "\x88\x02" "\x89\x01");
+    TEST_CHECK(test_text_is(&dtvcc, 1, "ZERO"));
+    TEST_BLOCK(&dtvcc, 1, "\x8C\x03" "LOST");
+    TEST_CHECK(test_text_is(&dtvcc, 1, ""));
+    TEST_CHECK(-1 == dtvcc_service(&dtvcc, 1)->current);
+
+    // Reset deletes every window
+    TEST_BLOCK(&dtvcc, 1, TEST_DF0 "BACK");
+    TEST_CHECK(test_text_is(&dtvcc, 1, "BACK"));
+    TEST_BLOCK(&dtvcc, 1, "\x8F");
+    TEST_CHECK(test_text_is(&dtvcc, 1, ""));
+    TEST_CHECK(!dtvcc_service(&dtvcc, 1)->window[0].defined);
+
+    dtvcc_free(&dtvcc);
+}
+
+// Extended service numbers 7 - 63 follow a service number of 7, 0 - 6 are reserved
+static void test_extended_services()
+{
+    dtvcc_t dtvcc;
+    test_packet_t packet;
+
+    dtvcc_init(&dtvcc);
+    test_packet_init(&packet);
+    test_packet_block(&packet, 7, TEST_DF0 "SEVEN", 12);
+    test_packet_block(&packet, 63, TEST_DF0 "LAST", 11);
+    TEST_CHECK(LIBCAPTION_READY == test_packet_send(&dtvcc, &packet, 0));
+    TEST_CHECK(((uint64_t)1 << 7 | (uint64_t)1 << 63) == dtvcc.ready);
+    TEST_CHECK(test_text_is(&dtvcc, 7, "SEVEN"));
+    TEST_CHECK(test_text_is(&dtvcc, 63, "LAST"));
+
+    // A reserved extended number skips its block, the blocks after it still decode
+    test_packet_init(&packet);
+    test_packet_block(&packet, 7, TEST_DF0 "NO", 9);
+    packet.data[2] = 3;
+    test_packet_block(&packet, 1, TEST_DF0 "YES", 10);
+    dtvcc.ready = 0;
+    TEST_CHECK(LIBCAPTION_READY == test_packet_send(&dtvcc, &packet, 0));
+    TEST_CHECK(((uint64_t)1 << 1) == dtvcc.ready);
+    TEST_CHECK(0 == dtvcc_service(&dtvcc, 3));
+    TEST_CHECK(test_text_is(&dtvcc, 7, "SEVEN"));
+    TEST_CHECK(test_text_is(&dtvcc, 1, "YES"));
+
+    dtvcc_free(&dtvcc);
+}
+
+// Text never goes past the window's own rows and columns, even after it is redefined smaller
+static void test_clipping()
+{
+    dtvcc_t dtvcc;
+
+    dtvcc_init(&dtvcc);
+    // 2 rows of 5 columns, no word wrap
+    TEST_BLOCK(&dtvcc, 1, "\x98\x20\x00\x00\x01\x04\x00" "ABCDEFG" "\x0D" "HIJ");
+    TEST_CHECK(test_text_is(&dtvcc, 1, "ABCDE\nHIJ"));
+
+    // The clipped text was never stored, growing the window doesn't bring it back
+    TEST_BLOCK(&dtvcc, 1, "\x98\x20\x00\x00\x01\x09\x00");
+    TEST_CHECK(test_text_is(&dtvcc, 1, "ABCDE\nHIJ"));
+    TEST_BLOCK(&dtvcc, 1, "\x98\x20\x00\x00\x01\x04\x00");
+
+    // A carriage return on the last row scrolls up
+    TEST_BLOCK(&dtvcc, 1, "\x0D" "KLMNOPQ");
+    TEST_CHECK(test_text_is(&dtvcc, 1, "HIJ\nKLMNO"));
+
+    // SetPenLocation past the window stops at its last row and column
+    TEST_BLOCK(&dtvcc, 1, "\x92\x0E\x29" "Z");
+    TEST_CHECK(test_text_is(&dtvcc, 1, "HIJ\nKLMNZ"));
+
+    // Redefined as 1 row of 3, the pen and the rendered text stay inside it
+    TEST_BLOCK(&dtvcc, 1, "\x98\x20\x00\x00\x00\x02\x00");
+    TEST_CHECK(1 == dtvcc_service(&dtvcc, 1)->window[0].row_count && 0 == dtvcc_service(&dtvcc, 1)->window[0].row);
+    TEST_CHECK(3 == dtvcc_service(&dtvcc, 1)->window[0].col_count && 3 == dtvcc_service(&dtvcc, 1)->window[0].col);
+    TEST_CHECK(test_text_is(&dtvcc, 1, "HIJ"));
+    TEST_BLOCK(&dtvcc, 1, "X");
+    TEST_CHECK(test_text_is(&dtvcc, 1, "HIJ"));
+
+    // Sizes past the 708 maximum are limited to 15 x 42
+    TEST_BLOCK(&dtvcc, 1, "\x99\x20\x00\x00\x0F\x3F\x00");
+    TEST_CHECK(DTVCC_MAX_ROWS == dtvcc_service(&dtvcc, 1)->window[1].row_count);
+    TEST_CHECK(DTVCC_MAX_COLS == dtvcc_service(&dtvcc, 1)->window[1].col_count);
+
+    dtvcc_free(&dtvcc);
+}
+
+int main(int argc, char** argv)
+{
+    test_service_blocks();
+    test_windows();
+    test_extended_services();
+    test_clipping();
+    TEST_RESULT();
+}
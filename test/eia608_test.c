@@ -0,0 +1,84 @@
+/**********************************************************************************************/
+/* The MIT License                                                                            */
+/*                                                                                            */
+/* Copyright 2016-2017 Twitch Interactive, Inc. or its affiliates. All Rights Reserved.       */
+/*                                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy               */
+/* of this software and associated documentation files (the "Software"), to deal              */
+/* in the Software without restriction, including without limitation the rights               */
+/* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell                  */
+/* copies of the Software, and to permit persons to whom the Software is                      */
+/* furnished to do so, subject to the following conditions:                                   */
+/*                                                                                            */
+/* The above copyright notice and this permission notice shall be included in                 */
+/* all copies or substantial portions of the Software.                                        */
+/*                                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR                 */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,                   */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE                */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER                     */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,              */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN                  */
+/* THE SOFTWARE.                                                                              */
+/**********************************************************************************************/
+// Checks for the cc_data classifier in eia608.c. Build from the repo root with
+//
+//     cc -Isrc -o eia608_test test/eia608_test.c src/eia608.c src/eia608_charmap.c src/eia608_from_utf8.c src/utf8.c
+//
+// and run ./eia608_test, it returns non zero if a check failed.
+
+#include "eia608.h"
+#include "test.h"
+
+// The predicate chain caption_frame_decode used before the lookup tables, in the same order
+static eia608_class_t test_classify_predicates(uint16_t cc_data)
+{
+    if (!eia608_parity_varify(cc_data)) {
+        return eia608_class_invalid;
+    } else if (eia608_is_padding(cc_data)) {
+        return eia608_class_padding;
+    } else if (eia608_is_control(cc_data)) {
+        return eia608_class_control;
+    } else if (eia608_is_basicna(cc_data)) {
+        return eia608_class_basicna;
+    } else if (eia608_is_specialna(cc_data)) {
+        return eia608_class_specialna;
+    } else if (eia608_is_westeu(cc_data)) {
+        return eia608_class_westeu;
+    } else if (eia608_is_preamble(cc_data)) {
+        return eia608_class_preamble;
+    } else if (eia608_is_midrowchange(cc_data)) {
+        return eia608_class_midrowchange;
+    }
+
+    return eia608_class_none;
+}
+
+// The tables are built from their own copy of the masks, so compare every word with the predicates
+static void test_classify_tables()
+{
+    for (uint32_t cc_data = 0; cc_data <= 0xFFFF; ++cc_data) {
+        eia608_class_t expected = test_classify_predicates((uint16_t)cc_data);
+
+        if (expected != eia608_classify((uint16_t)cc_data)) {
+            fprintf(stderr, "cc_data 0x%04X: class 0x%02X, predicates give 0x%02X\n", cc_data, eia608_classify((uint16_t)cc_data), expected);
+            TEST_CHECK(expected == eia608_classify((uint16_t)cc_data));
+        }
+    }
+}
+
+// Every class but none holds exactly one bit, so a switch on the class covers each word once
+static void test_classify_exclusive()
+{
+    for (uint32_t cc_data = 0; cc_data <= 0xFFFF; ++cc_data) {
+        unsigned type = eia608_classify((uint16_t)cc_data);
+        TEST_CHECK(0 == (type & (type - 1)));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    test_classify_tables();
+    test_classify_exclusive();
+    TEST_RESULT();
+}
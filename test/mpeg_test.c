@@ -0,0 +1,550 @@
+/**********************************************************************************************/
+/* The MIT License                                                                            */
+/*                                                                                            */
+/* Copyright 2016-2017 Twitch Interactive, Inc. or its affiliates. All Rights Reserved.       */
+/*                                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy               */
+/* of this software and associated documentation files (the "Software"), to deal              */
+/* in the Software without restriction, including without limitation the rights               */
+/* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell                  */
+/* copies of the Software, and to permit persons to whom the Software is                      */
+/* furnished to do so, subject to the following conditions:                                   */
+/*                                                                                            */
+/* The above copyright notice and this permission notice shall be included in                 */
+/* all copies or substantial portions of the Software.                                        */
+/*                                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR                 */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,                   */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE                */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER                     */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,              */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN                  */
+/* THE SOFTWARE.                                                                              */
+/**********************************************************************************************/
+// Checks for the NALU buffering and caption reordering in mpeg.c. Build from the repo root with
+//
+//     cc -Isrc -o mpeg_test test/mpeg_test.c src/caption.c src/cea708.c src/dtvcc.c src/eia608.c src/eia608_charmap.c src/eia608_from_utf8.c src/trace.c src/utf8.c
+//
+// and run ./mpeg_test, it returns non zero if a check failed.
+
+// The queue and SPS parsers are static, so build them into this file
+#include "../src/mpeg.c"
+#include "test.h"
+
+#define TEST_FRAME_RATE 30.0
+
+// Appends a NALU with its start code to data, inserting emulation prevention bytes into the payload
+static size_t test_put_nalu(uint8_t* data, const uint8_t* header, size_t header_size, const uint8_t* rbsp, size_t size)
+{
+    size_t i, pos = 0, zeros = 0;
+
+    data[pos++] = 0, data[pos++] = 0, data[pos++] = 1;
+
+    for (i = 0; i < header_size; ++i) {
+        data[pos++] = header[i];
+    }
+
+    for (i = 0; i < size; ++i) {
+        if (2 <= zeros && 3 >= rbsp[i]) {
+            data[pos++] = 3, zeros = 0;
+        }
+
+        zeros = rbsp[i] ? 0 : zeros + 1;
+        data[pos++] = rbsp[i];
+    }
+
+    return pos;
+}
+
+// Appends an HEVC slice, it is never buffered so the payload doesn't matter
+static size_t test_put_hevc_slice(uint8_t* data)
+{
+    static const uint8_t header[] = { 0x02, 0x01 }, rbsp[] = { 0xAF, 0x11, 0x22, 0x33, 0x44, 0x80 };
+    return test_put_nalu(data, header, sizeof(header), rbsp, sizeof(rbsp));
+}
+
+// Appends an SEI NALU carrying two field 1 cc_data words as ATSC A/53 user data
+static size_t test_put_cc_sei(uint8_t* data, unsigned stream_type, unsigned nal_unit_type, uint16_t cc1, uint16_t cc2)
+{
+    const uint8_t rbsp[] = {
+        sei_type_user_data_registered_itu_t_t35, 17, // payloadType, payloadSize
+        0xB5, 0x00, 0x31, 'G', 'A', '9', '4', 0x03, // itu_t_t35 country and provider, GA94, cc_data()
+        0x40 | 2, 0xFF, // process_cc_data_flag, cc_count, em_data
+        0xFC, cc1 >> 8, cc1 & 0xFF, 0xFC, cc2 >> 8, cc2 & 0xFF, 0xFF, // cc_data triplets, marker_bits
+        0x80, // rbsp_trailing_bits
+    };
+
+    if (STREAM_TYPE_H265 == stream_type) {
+        const uint8_t header[] = { nal_unit_type << 1, 0x01 };
+        return test_put_nalu(data, header, sizeof(header), rbsp, sizeof(rbsp));
+    } else {
+        const uint8_t header[] = { nal_unit_type };
+        return test_put_nalu(data, header, sizeof(header), rbsp, sizeof(rbsp));
+    }
+}
+
+// Resume direct captioning then one character, so every SEI is a READY frame stamped with its own timestamp
+static size_t test_put_painton_sei(uint8_t* data, unsigned stream_type, unsigned nal_unit_type, int i)
+{
+    uint16_t rdc = eia608_control_command(eia608_control_resume_direct_captioning, 0);
+    return test_put_cc_sei(data, stream_type, nal_unit_type, rdc, eia608_parity((uint16_t)((('A' + (i % 26)) << 8) | 0x80)));
+}
+
+static int test_compare_double(const void* a, const void* b)
+{
+    return *(const double*)a < *(const double*)b ? -1 : *(const double*)a > *(const double*)b;
+}
+
+// Timestamps of the READY frames, in the order they were released
+typedef struct {
+    int count;
+    double timestamp[64];
+} test_released_t;
+
+static void test_release(test_released_t* released, mpeg_bitstream_t* packet, caption_frame_t* frame)
+{
+    if (LIBCAPTION_READY == mpeg_bitstream_status(packet) && 64 > released->count) {
+        released->timestamp[released->count++] = frame->timestamp;
+    }
+}
+
+// Access unit i as one PES: a slice then a suffix SEI with its captions. The suffix SEI only ends
+// when the next PES arrives, and a LIBCAPTION_READY can leave whole NALUs buffered for the call
+// after that. B pictures, so presentation order differs from decode order
+static void test_parse_suffix_seis(test_released_t* released, mpeg_bitstream_t* packet, caption_frame_t* frame, int first, int count, double* pts)
+{
+    uint8_t data[256];
+
+    for (int i = first; i < first + count; ++i) {
+        double dts = i / TEST_FRAME_RATE, cts = (i % 3) / TEST_FRAME_RATE;
+        size_t size = test_put_hevc_slice(data);
+        size += test_put_painton_sei(&data[size], STREAM_TYPE_H265, H265_SEI_SUFFIX_PACKET, i);
+        pts[i - first] = dts + cts;
+
+        TEST_CHECK(size == mpeg_bitstream_parse(0, packet, frame, data, size, STREAM_TYPE_H265, dts, cts));
+        test_release(released, packet, frame);
+    }
+}
+
+static void test_flush(test_released_t* released, mpeg_bitstream_t* packet, caption_frame_t* frame)
+{
+    while (mpeg_bitstream_flush(packet, frame) || LIBCAPTION_READY == mpeg_bitstream_status(packet)) {
+        test_release(released, packet, frame);
+    }
+}
+
+// Captions come out in presentation order, each with its own access unit's timestamp
+static void test_check_released(test_released_t* released, double* pts, int count)
+{
+    qsort(pts, count, sizeof(pts[0]), test_compare_double);
+    TEST_CHECK(count == released->count);
+
+    for (int i = 0; i < count && i < released->count; ++i) {
+        TEST_CHECK(pts[i] == released->timestamp[i]);
+    }
+}
+
+static void test_suffix_sei_timestamps()
+{
+    uint8_t data[64];
+    caption_frame_t frame;
+    mpeg_bitstream_t packet;
+    test_released_t released = { 0 };
+    double pts[32];
+
+    caption_frame_init(&frame);
+    mpeg_bitstream_init(&packet);
+    test_parse_suffix_seis(&released, &packet, &frame, 0, 32, pts);
+
+    // The next access unit's slice ends the last suffix SEI
+    size_t size = test_put_hevc_slice(data);
+    TEST_CHECK(size == mpeg_bitstream_parse(0, &packet, &frame, data, size, STREAM_TYPE_H265, 32 / TEST_FRAME_RATE, 0));
+    test_release(&released, &packet, &frame);
+
+    test_flush(&released, &packet, &frame);
+    test_check_released(&released, pts, 32);
+    mpeg_bitstream_free(&packet);
+}
+
+// At the end of a segment the flush parses every NALU still buffered with its own timestamps,
+// then the next segment starts without any of them
+static void test_flush_timestamps()
+{
+    caption_frame_t frame;
+    mpeg_bitstream_t packet;
+    test_released_t released = { 0 };
+    double pts[32];
+
+    caption_frame_init(&frame);
+    mpeg_bitstream_init(&packet);
+
+    for (int segment = 0; segment < 2; ++segment) {
+        released.count = 0;
+        test_parse_suffix_seis(&released, &packet, &frame, 32 * segment, 32, pts);
+        // The last READY left the slice and the suffix SEI for the flush
+        TEST_CHECK(find_start_code(&packet.data[packet.pos], packet.size, 6));
+
+        test_flush(&released, &packet, &frame);
+        test_check_released(&released, pts, 32);
+        TEST_CHECK(0 == packet.size && 0 == packet.calls && 0 == packet.latent);
+    }
+
+    mpeg_bitstream_free(&packet);
+}
+
+// Queues a frame tagged with its arrival number in em_data, which the queue never reads
+static void test_emplace(mpeg_bitstream_t* packet, double timestamp, int tag)
+{
+    cea708_t* cea708 = _mpeg_bitstream_cea708_emplace(packet, timestamp);
+    cea708->user_data.em_data = tag;
+}
+
+// Pops the earliest frame, returns its tag
+static int test_pop(mpeg_bitstream_t* packet, double* timestamp)
+{
+    cea708_t* cea708 = _mpeg_bitstream_cea708_front(packet);
+    int tag = cea708->user_data.em_data;
+
+    (*timestamp) = cea708->timestamp;
+    _mpeg_bitstream_cea708_pop(packet);
+    return tag;
+}
+
+// Out of order timestamps come out sorted, equal ones in arrival order
+static void test_queue_order()
+{
+    static const double timestamps[] = { 5, 1, 4, 1, 3, 2, 5, 0, 4, 1 };
+    static const int expected[] = { 7, 1, 3, 9, 5, 4, 2, 8, 0, 6 };
+    mpeg_bitstream_t packet;
+    double timestamp;
+    int i;
+
+    mpeg_bitstream_init(&packet);
+    TEST_CHECK(0 == _mpeg_bitstream_cea708_front(&packet));
+
+    for (i = 0; i < 10; ++i) {
+        test_emplace(&packet, timestamps[i], i);
+    }
+
+    for (i = 0; i < 10; ++i) {
+        TEST_CHECK(expected[i] == test_pop(&packet, &timestamp));
+        TEST_CHECK(timestamps[expected[i]] == timestamp);
+    }
+
+    TEST_CHECK(0 == packet.latent && 0 == _mpeg_bitstream_cea708_front(&packet));
+
+    // Popped slots go back to the free list and are reused, the arrival order keeps counting
+    for (i = 0; i < 3; ++i) {
+        test_emplace(&packet, 7, 10 + i);
+    }
+
+    for (i = 0; i < 3; ++i) {
+        TEST_CHECK(10 + i == test_pop(&packet, &timestamp));
+    }
+
+    mpeg_bitstream_free(&packet);
+}
+
+// A push on a full queue decodes and drops the earliest frame first, never the new one
+static void test_queue_full()
+{
+    caption_frame_t frame;
+    mpeg_bitstream_t packet;
+    double timestamp, last = -1;
+    int i;
+
+    caption_frame_init(&frame);
+    mpeg_bitstream_init(&packet);
+
+    // Descending, so the earliest frame is always the last one queued
+    for (i = 0; i < MAX_REFRENCE_FRAMES; ++i) {
+        test_emplace(&packet, MAX_REFRENCE_FRAMES - i, i);
+    }
+
+    TEST_CHECK(MAX_REFRENCE_FRAMES == packet.latent);
+    _mpeg_bitstream_cea708_push(&packet, &frame, 0, 0.5)->user_data.em_data = MAX_REFRENCE_FRAMES;
+    TEST_CHECK(MAX_REFRENCE_FRAMES == packet.latent);
+
+    // Timestamp 1 was released, the new frame is now the earliest
+    TEST_CHECK(MAX_REFRENCE_FRAMES == test_pop(&packet, &timestamp));
+    TEST_CHECK(0.5 == timestamp);
+
+    for (i = 2; i <= MAX_REFRENCE_FRAMES; ++i) {
+        TEST_CHECK(MAX_REFRENCE_FRAMES - i == test_pop(&packet, &timestamp));
+        TEST_CHECK(last < timestamp && i == timestamp);
+        last = timestamp;
+    }
+
+    TEST_CHECK(0 == packet.latent);
+    mpeg_bitstream_free(&packet);
+}
+
+// Frames wait until more than reorder are queued, or the decode time has passed them
+static void test_queue_release()
+{
+    caption_frame_t frame;
+    mpeg_bitstream_t packet;
+    double timestamp;
+
+    caption_frame_init(&frame);
+    mpeg_bitstream_init(&packet);
+    packet.reorder = 2;
+
+    test_emplace(&packet, 3, 0);
+    test_emplace(&packet, 2, 1);
+    _mpeg_bitstream_cea708_release(&packet, &frame, 0, 1);
+    TEST_CHECK(2 == packet.latent);
+
+    // A third frame means no later one can come before timestamp 2
+    test_emplace(&packet, 4, 2);
+    _mpeg_bitstream_cea708_release(&packet, &frame, 0, 1);
+    TEST_CHECK(2 == packet.latent);
+    TEST_CHECK(0 == test_pop(&packet, &timestamp) && 3 == timestamp);
+
+    // Reaching the decode time releases the rest
+    _mpeg_bitstream_cea708_release(&packet, &frame, 0, 5);
+    TEST_CHECK(0 == packet.latent);
+
+    mpeg_bitstream_free(&packet);
+}
+
+// Bit writer for building parameter sets
+typedef struct {
+    uint8_t data[64];
+    size_t bits;
+} test_bits_t;
+
+static void test_u(test_bits_t* b, int n, uint32_t v)
+{
+    for (int i = n - 1; 0 <= i; --i, ++b->bits) {
+        b->data[b->bits / 8] |= ((v >> i) & 1) << (7 - b->bits % 8);
+    }
+}
+
+static void test_ue(test_bits_t* b, uint32_t v)
+{
+    int n = 0;
+
+    while ((v + 1) >> (n + 1)) {
+        ++n;
+    }
+
+    test_u(b, n, 0);
+    test_u(b, n + 1, v + 1);
+}
+
+// rbsp_trailing_bits, returns the size in bytes
+static size_t test_trailing(test_bits_t* b)
+{
+    test_u(b, 1, 1);
+
+    while (b->bits % 8) {
+        test_u(b, 1, 0);
+    }
+
+    return b->bits / 8;
+}
+
+// Parses one parameter set NALU, with an access unit delimiter after it to end it, and
+// returns the reorder depth it set
+static size_t test_parse_sps(unsigned stream_type, test_bits_t* b)
+{
+    static const uint8_t avc_sps[] = { 0x67 }, avc_aud[] = { 0x09 }, hevc_sps[] = { 0x42, 0x01 }, hevc_aud[] = { 0x46, 0x01 }, aud[] = { 0x50 };
+    uint8_t data[128];
+    size_t size, rbsp_size = test_trailing(b), reorder;
+    caption_frame_t frame;
+    mpeg_bitstream_t packet;
+
+    if (STREAM_TYPE_H265 == stream_type) {
+        size = test_put_nalu(data, hevc_sps, sizeof(hevc_sps), b->data, rbsp_size);
+        size += test_put_nalu(&data[size], hevc_aud, sizeof(hevc_aud), aud, sizeof(aud));
+    } else {
+        size = test_put_nalu(data, avc_sps, sizeof(avc_sps), b->data, rbsp_size);
+        size += test_put_nalu(&data[size], avc_aud, sizeof(avc_aud), aud, sizeof(aud));
+    }
+
+    caption_frame_init(&frame);
+    mpeg_bitstream_init(&packet);
+    TEST_CHECK(size == mpeg_bitstream_parse(0, &packet, &frame, data, size, stream_type, 0, 0));
+    reorder = packet.reorder;
+    mpeg_bitstream_free(&packet);
+    return reorder;
+}
+
+#define TEST_AVC_NO_VUI -1 // vui_parameters_present_flag = 0
+#define TEST_AVC_NO_RESTRICTION -2 // VUI without bitstream_restriction
+
+// seq_parameter_set_data() for a 4:2:0 8 bit picture of width x height macroblocks
+static void test_put_avc_sps(test_bits_t* b, uint32_t profile_idc, uint32_t constraint_flags, uint32_t level_idc, uint32_t width, uint32_t height, int frame_mbs_only, int max_num_reorder_frames)
+{
+    test_u(b, 8, profile_idc);
+    test_u(b, 8, constraint_flags);
+    test_u(b, 8, level_idc);
+    test_ue(b, 0); // seq_parameter_set_id
+
+    if (100 == profile_idc) {
+        test_ue(b, 1); // chroma_format_idc
+        test_ue(b, 0); // bit_depth_luma_minus8
+        test_ue(b, 0); // bit_depth_chroma_minus8
+        test_u(b, 1, 0); // qpprime_y_zero_transform_bypass_flag
+        test_u(b, 1, 0); // seq_scaling_matrix_present_flag
+    }
+
+    test_ue(b, 0); // log2_max_frame_num_minus4
+    test_ue(b, 0); // pic_order_cnt_type
+    test_ue(b, 2); // log2_max_pic_order_cnt_lsb_minus4
+    test_ue(b, 4); // max_num_ref_frames
+    test_u(b, 1, 0); // gaps_in_frame_num_value_allowed_flag
+    test_ue(b, width - 1);
+    test_ue(b, (frame_mbs_only ? height : height / 2) - 1);
+    test_u(b, 1, frame_mbs_only);
+
+    if (!frame_mbs_only) {
+        test_u(b, 1, 0); // mb_adaptive_frame_field_flag
+    }
+
+    test_u(b, 1, 1); // direct_8x8_inference_flag
+    test_u(b, 1, 1); // frame_cropping_flag, 1080 lines out of 1088
+    test_ue(b, 0), test_ue(b, 0), test_ue(b, 0), test_ue(b, 4);
+
+    test_u(b, 1, TEST_AVC_NO_VUI != max_num_reorder_frames); // vui_parameters_present_flag
+
+    if (TEST_AVC_NO_VUI == max_num_reorder_frames) {
+        return;
+    }
+
+    test_u(b, 1, 1); // aspect_ratio_info_present_flag
+    test_u(b, 8, 255), test_u(b, 16, 4), test_u(b, 16, 3); // Extended_SAR
+    test_u(b, 1, 0); // overscan_info_present_flag
+    test_u(b, 1, 1); // video_signal_type_present_flag
+    test_u(b, 4, 0xA), test_u(b, 1, 1), test_u(b, 24, 0x010101);
+    test_u(b, 1, 0); // chroma_loc_info_present_flag
+    test_u(b, 1, 1); // timing_info_present_flag
+    test_u(b, 32, 1001), test_u(b, 32, 60000), test_u(b, 1, 1);
+    test_u(b, 1, 1); // nal_hrd_parameters_present_flag
+    test_ue(b, 1), test_u(b, 8, 0x34); // cpb_cnt_minus1, bit_rate_scale, cpb_size_scale
+    test_ue(b, 20000), test_ue(b, 30000), test_u(b, 1, 0);
+    test_ue(b, 40000), test_ue(b, 50000), test_u(b, 1, 1);
+    test_u(b, 20, 0xBDEF7); // delay and time offset lengths
+    test_u(b, 1, 0); // vcl_hrd_parameters_present_flag
+    test_u(b, 1, 0); // low_delay_hrd_flag
+    test_u(b, 1, 1); // pic_struct_present_flag
+    test_u(b, 1, TEST_AVC_NO_RESTRICTION != max_num_reorder_frames); // bitstream_restriction_flag
+
+    if (TEST_AVC_NO_RESTRICTION != max_num_reorder_frames) {
+        test_u(b, 1, 1); // motion_vectors_over_pic_boundaries_flag
+        test_ue(b, 2), test_ue(b, 1), test_ue(b, 16), test_ue(b, 16);
+        test_ue(b, (uint32_t)max_num_reorder_frames);
+        test_ue(b, 4); // max_dec_frame_buffering
+    }
+}
+
+static size_t test_avc_reorder(uint32_t profile_idc, uint32_t constraint_flags, uint32_t level_idc, uint32_t width, uint32_t height, int frame_mbs_only, int max_num_reorder_frames)
+{
+    test_bits_t b = { { 0 }, 0 };
+    test_put_avc_sps(&b, profile_idc, constraint_flags, level_idc, width, height, frame_mbs_only, max_num_reorder_frames);
+    return test_parse_sps(STREAM_TYPE_H264, &b);
+}
+
+static void test_avc_sps()
+{
+    // 1080p High@4.0 without the value, MaxDpbMbs / PicSizeInMbs = 32768 / 8160
+    TEST_CHECK(4 == test_avc_reorder(100, 0x00, 40, 120, 68, 1, TEST_AVC_NO_VUI));
+    TEST_CHECK(4 == test_avc_reorder(100, 0x00, 40, 120, 68, 1, TEST_AVC_NO_RESTRICTION));
+    // 1080i, two fields of 34 map units
+    TEST_CHECK(4 == test_avc_reorder(100, 0x00, 40, 120, 68, 0, TEST_AVC_NO_VUI));
+    // 720p Main@3.1, 18000 / 3600
+    TEST_CHECK(5 == test_avc_reorder(77, 0x40, 31, 80, 45, 1, TEST_AVC_NO_RESTRICTION));
+    // The inferred value is capped at 16
+    TEST_CHECK(16 == test_avc_reorder(66, 0xC0, 51, 20, 15, 1, TEST_AVC_NO_VUI));
+    // High intra has no reordering
+    TEST_CHECK(0 == test_avc_reorder(100, 0x10, 40, 120, 68, 1, TEST_AVC_NO_VUI));
+
+    // bitstream_restriction carries the value
+    TEST_CHECK(2 == test_avc_reorder(100, 0x00, 40, 120, 68, 1, 2));
+    TEST_CHECK(0 == test_avc_reorder(77, 0x40, 31, 80, 45, 1, 0));
+    TEST_CHECK(1 == test_avc_reorder(100, 0x00, 40, 120, 68, 0, 1));
+    TEST_CHECK(MAX_REFRENCE_FRAMES == test_avc_reorder(100, 0x00, 40, 120, 68, 1, MAX_REFRENCE_FRAMES + 1));
+}
+
+// seq_parameter_set_rbsp() up to the sub layer ordering info. reorder[i] is sps_max_num_reorder_pics
+// for sub layer i, only the highest one is written when ordering_info is not set
+static void test_put_hevc_sps(test_bits_t* b, uint32_t max_sub_layers_minus1, uint32_t sub_layer_flags, int ordering_info, const uint32_t* reorder)
+{
+    test_u(b, 4, 0); // sps_video_parameter_set_id
+    test_u(b, 3, max_sub_layers_minus1);
+    test_u(b, 1, 1); // sps_temporal_id_nesting_flag
+
+    // profile_tier_level( 1, sps_max_sub_layers_minus1 ), Main tier level 4.1
+    test_u(b, 8, 0x01), test_u(b, 32, 0x60000000), test_u(b, 24, 0x900000), test_u(b, 24, 0), test_u(b, 8, 123);
+
+    for (uint32_t i = 0; i < max_sub_layers_minus1; ++i) {
+        test_u(b, 2, (sub_layer_flags >> (2 * i)) & 3); // sub_layer_profile_present_flag, sub_layer_level_present_flag
+    }
+
+    if (0 < max_sub_layers_minus1) {
+        test_u(b, 2 * (8 - max_sub_layers_minus1), 0); // reserved_zero_2bits
+    }
+
+    for (uint32_t i = 0; i < max_sub_layers_minus1; ++i) {
+        if (2 & (sub_layer_flags >> (2 * i))) {
+            test_u(b, 8, 0x01), test_u(b, 32, 0x60000000), test_u(b, 24, 0x900000), test_u(b, 24, 0);
+        }
+
+        if (1 & (sub_layer_flags >> (2 * i))) {
+            test_u(b, 8, 90 + 3 * i);
+        }
+    }
+
+    test_ue(b, 0); // sps_seq_parameter_set_id
+    test_ue(b, 1); // chroma_format_idc
+    test_ue(b, 1920), test_ue(b, 1088);
+    test_u(b, 1, 1); // conformance_window_flag
+    test_ue(b, 0), test_ue(b, 0), test_ue(b, 0), test_ue(b, 4);
+    test_ue(b, 2), test_ue(b, 2); // 10 bit
+    test_ue(b, 4); // log2_max_pic_order_cnt_lsb_minus4
+    test_u(b, 1, ordering_info);
+
+    for (uint32_t i = ordering_info ? 0 : max_sub_layers_minus1; i <= max_sub_layers_minus1; ++i) {
+        test_ue(b, reorder[i] + 1); // sps_max_dec_pic_buffering_minus1
+        test_ue(b, reorder[i]);
+        test_ue(b, 0); // sps_max_latency_increase_plus1
+    }
+
+    // The rest of the SPS is never read
+    test_ue(b, 0), test_ue(b, 3), test_ue(b, 0), test_ue(b, 3);
+}
+
+static size_t test_hevc_reorder(uint32_t max_sub_layers_minus1, uint32_t sub_layer_flags, int ordering_info, const uint32_t* reorder)
+{
+    test_bits_t b = { { 0 }, 0 };
+    test_put_hevc_sps(&b, max_sub_layers_minus1, sub_layer_flags, ordering_info, reorder);
+    return test_parse_sps(STREAM_TYPE_H265, &b);
+}
+
+static void test_hevc_sps()
+{
+    static const uint32_t reorder[] = { 0, 1, 3, 2 };
+
+    TEST_CHECK(0 == test_hevc_reorder(0, 0, 1, reorder));
+    TEST_CHECK(2 == test_hevc_reorder(0, 0, 0, &reorder[3]));
+    // HighestTid is the last sub layer, with and without the lower ones signalled
+    TEST_CHECK(3 == test_hevc_reorder(2, 0, 1, reorder));
+    TEST_CHECK(3 == test_hevc_reorder(2, 0, 0, reorder));
+    TEST_CHECK(2 == test_hevc_reorder(3, 0, 1, reorder));
+    // Sub layer profile and level in profile_tier_level are skipped
+    TEST_CHECK(3 == test_hevc_reorder(2, 0x0B, 1, reorder));
+    TEST_CHECK(2 == test_hevc_reorder(3, 0x39, 0, reorder));
+}
+
+int main(int argc, char** argv)
+{
+    test_suffix_sei_timestamps();
+    test_flush_timestamps();
+    test_queue_order();
+    test_queue_full();
+    test_queue_release();
+    test_avc_sps();
+    test_hevc_sps();
+    TEST_RESULT();
+}
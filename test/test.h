@@ -0,0 +1,53 @@
+/**********************************************************************************************/
+/* The MIT License                                                                            */
+/*                                                                                            */
+/* Copyright 2016-2017 Twitch Interactive, Inc. or its affiliates. All Rights Reserved.       */
+/*                                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy               */
+/* of this software and associated documentation files (the "Software"), to deal              */
+/* in the Software without restriction, including without limitation the rights               */
+/* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell                  */
+/* copies of the Software, and to permit persons to whom the Software is                      */
+/* furnished to do so, subject to the following conditions:                                   */
+/*                                                                                            */
+/* The above copyright notice and this permission notice shall be included in                 */
+/* all copies or substantial portions of the Software.                                        */
+/*                                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR                 */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,                   */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE                */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER                     */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,              */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN                  */
+/* THE SOFTWARE.                                                                              */
+/**********************************************************************************************/
+#ifndef LIBCAPTION_TEST_H
+#define LIBCAPTION_TEST_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+
+// Checks in a test program share one failure count, main returns it
+static int test_failures = 0;
+
+#define TEST_CHECK(COND)                                                      \
+    do {                                                                      \
+        if (!(COND)) {                                                        \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #COND); \
+            ++test_failures;                                                  \
+        }                                                                     \
+    } while (0)
+
+// Ends main, prints a summary and returns non zero if any check failed
+#define TEST_RESULT()                                                        \
+    do {                                                                     \
+        fprintf(stderr, "%s: %s\n", __FILE__, test_failures ? "FAILED" : "OK"); \
+        return test_failures ? 1 : 0;                                        \
+    } while (0)
+
+#ifdef __cplusplus
+}
+#endif
+#endif
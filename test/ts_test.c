@@ -0,0 +1,348 @@
+/**********************************************************************************************/
+/* The MIT License                                                                            */
+/*                                                                                            */
+/* Copyright 2016-2017 Twitch Interactive, Inc. or its affiliates. All Rights Reserved.       */
+/*                                                                                            */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy               */
+/* of this software and associated documentation files (the "Software"), to deal              */
+/* in the Software without restriction, including without limitation the rights               */
+/* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell                  */
+/* copies of the Software, and to permit persons to whom the Software is                      */
+/* furnished to do so, subject to the following conditions:                                   */
+/*                                                                                            */
+/* The above copyright notice and this permission notice shall be included in                 */
+/* all copies or substantial portions of the Software.                                        */
+/*                                                                                            */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR                 */
+/* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,                   */
+/* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE                */
+/* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER                     */
+/* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,              */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN                  */
+/* THE SOFTWARE.                                                                              */
+/**********************************************************************************************/
+// Checks for the sync recovery and batch parsing in ts.c. Build from the repo root with
+//
+//     cc -Isrc -o ts_test test/ts_test.c src/trace.c
+//
+// and run ./ts_test, it returns non zero if a check failed.
+
+// The sync scanner is static, so build it into this file
+#include "../src/ts.c"
+#include "test.h"
+#include <stdlib.h>
+
+#define TEST_PMT_PID 0x100
+#define TEST_VIDEO_PID 0x101
+#define TEST_VIDEO_PACKETS 64
+#define TEST_PACKETS (2 + TEST_VIDEO_PACKETS)
+
+static uint32_t test_crc32(const uint8_t* data, size_t size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    while (size--) {
+        crc ^= (uint32_t)(*data++) << 24;
+
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+// Writes a 188 byte packet holding one PSI section, stuffed with 0xFF
+static void test_put_section(uint8_t* pkt, uint16_t pid, const uint8_t* section, size_t size)
+{
+    uint32_t crc = test_crc32(section, size);
+
+    memset(pkt, 0xFF, TS_PACKET_SIZE);
+    pkt[0] = TS_SYNC_BYTE, pkt[1] = 0x40 | pid >> 8, pkt[2] = pid & 0xFF, pkt[3] = 0x10;
+    pkt[4] = 0; // pointer_field
+    memcpy(&pkt[5], section, size);
+    pkt[5 + size + 0] = crc >> 24, pkt[5 + size + 1] = crc >> 16;
+    pkt[5 + size + 2] = crc >> 8, pkt[5 + size + 3] = crc;
+}
+
+// PAT, PMT with one H.264 stream, then video packets. Each video payload starts with the
+// packet's number and never holds a sync byte, so the parsed packets can be told apart
+static void test_put_packets(uint8_t packets[TEST_PACKETS][TS_PACKET_SIZE])
+{
+    static const uint8_t pat[] = { 0x00, 0xB0, 13, 0x00, 0x01, 0xC1, 0x00, 0x00, 0x00, 0x01, 0xE0 | TEST_PMT_PID >> 8, TEST_PMT_PID & 0xFF };
+    static const uint8_t pmt[] = { 0x02, 0xB0, 18, 0x00, 0x01, 0xC1, 0x00, 0x00, 0xE0 | TEST_VIDEO_PID >> 8, TEST_VIDEO_PID & 0xFF, 0xF0, 0x00, STREAM_TYPE_H264, 0xE0 | TEST_VIDEO_PID >> 8, TEST_VIDEO_PID & 0xFF, 0xF0, 0x00 };
+
+    test_put_section(packets[0], 0, pat, sizeof(pat));
+    test_put_section(packets[1], TEST_PMT_PID, pmt, sizeof(pmt));
+
+    for (int k = 0; k < TEST_VIDEO_PACKETS; ++k) {
+        uint8_t* pkt = packets[2 + k];
+        memset(pkt, 0xFF, TS_PACKET_SIZE);
+        pkt[0] = TS_SYNC_BYTE, pkt[1] = TEST_VIDEO_PID >> 8, pkt[2] = TEST_VIDEO_PID & 0xFF, pkt[3] = 0x10 | (k & 0x0F);
+        pkt[4] = (uint8_t)k;
+    }
+}
+
+// Lays the packets out with a 4 byte M2TS timestamp prefix or 16 bytes of Reed-Solomon parity.
+// Returns the size written
+static size_t test_put_stream(uint8_t* data, size_t packet_size)
+{
+    static uint8_t packets[TEST_PACKETS][TS_PACKET_SIZE];
+    size_t size = 0;
+
+    test_put_packets(packets);
+
+    for (int k = 0; k < TEST_PACKETS; ++k) {
+        if (192 == packet_size) {
+            data[size++] = 0x00, data[size++] = 0x01, data[size++] = 0x02, data[size++] = (uint8_t)k;
+        }
+
+        memcpy(&data[size], packets[k], TS_PACKET_SIZE);
+        size += TS_PACKET_SIZE;
+
+        if (204 == packet_size) {
+            memset(&data[size], 0xA5, 16);
+            size += 16;
+        }
+    }
+
+    return size;
+}
+
+// Parses data in chunks the way a reader would, keeping whatever ts_parse_packets leaves and
+// appending the next chunk to it. Returns the number of video packets, their numbers go to seen
+static int test_parse_chunked(ts_t* ts, const uint8_t* data, size_t size, size_t chunk, int* seen)
+{
+    static uint8_t buffer[TEST_PACKETS * 204 + 1024];
+    size_t have = 0, pos, n;
+    int count = 0;
+
+    for (size_t i = 0; i < size; i += chunk) {
+        size_t add = size - i < chunk ? size - i : chunk;
+        memcpy(&buffer[have], &data[i], add);
+        have += add;
+
+        for (pos = 0; pos < have; pos += n) {
+            n = ts_parse_packets(ts, &buffer[pos], have - pos);
+
+            if (LIBCAPTION_READY != ts_status(ts)) {
+                pos += n;
+                break;
+            }
+
+            TEST_CHECK(TEST_VIDEO_PID == ts->stream[ts->current].pid && STREAM_TYPE_H264 == ts->stream_type);
+            TEST_CHECK(TS_PACKET_SIZE - 4 == ts->size);
+
+            if (TEST_PACKETS > count) {
+                seen[count++] = ts->data[0];
+            }
+        }
+
+        memmove(&buffer[0], &buffer[pos], have - pos);
+        have -= pos;
+    }
+
+    return count;
+}
+
+static void test_find_sync()
+{
+    uint8_t data[100];
+
+    // Past the 32 byte blocks the vector path scans, and in the byte tail after them
+    memset(data, 0, sizeof(data));
+    TEST_CHECK(sizeof(data) == ts_find_sync(data, sizeof(data), 0));
+
+    for (size_t i = 0; i < sizeof(data); ++i) {
+        data[i] = TS_SYNC_BYTE;
+        TEST_CHECK(i == ts_find_sync(data, sizeof(data), 0));
+        TEST_CHECK(i == ts_find_sync(data, sizeof(data), i));
+        TEST_CHECK(sizeof(data) == ts_find_sync(data, sizeof(data), i + 1));
+        TEST_CHECK(i == ts_find_sync(data, i, 0));
+        data[i] = 0;
+    }
+
+    data[3] = data[40] = data[97] = TS_SYNC_BYTE;
+    TEST_CHECK(40 == ts_find_sync(data, sizeof(data), 4));
+    TEST_CHECK(97 == ts_find_sync(data, sizeof(data), 41));
+}
+
+// Sync locks onto a run of TS_SYNC_LOCK packets of one size, stray sync bytes in front are skipped
+static void test_resync()
+{
+    static const size_t sizes[] = { 188, 192, 204 };
+    static uint8_t data[TEST_PACKETS * 204 + 100];
+    ts_t ts;
+    int locked;
+
+    for (int s = 0; s < 3; ++s) {
+        // Junk that holds sync bytes, none of them TS_SYNC_LOCK packets apart
+        memset(data, 0x11, 100);
+        data[0] = data[50] = data[99] = TS_SYNC_BYTE;
+        size_t size = 100 + test_put_stream(&data[100], sizes[s]);
+        size_t first = 192 == sizes[s] ? 104 : 100;
+
+        ts_init(&ts);
+        TEST_CHECK(first == ts_resync(&ts, data, size, &locked));
+        TEST_CHECK(locked && sizes[s] == ts.packet_size);
+
+        // Too short to confirm a run, the candidate is kept for when more data arrives
+        ts_init(&ts);
+        TEST_CHECK(first == ts_resync(&ts, data, first + 2 * sizes[s], &locked));
+        TEST_CHECK(!locked && 0 == ts.packet_size);
+
+        // The size it was locked on is tried first, it changes when the stream does
+        ts.packet_size = 188 == sizes[s] ? 204 : 188;
+        TEST_CHECK(first == ts_resync(&ts, data, size, &locked));
+        TEST_CHECK(locked && sizes[s] == ts.packet_size);
+    }
+
+    memset(data, 0, sizeof(data));
+    ts_init(&ts);
+    TEST_CHECK(sizeof(data) == ts_resync(&ts, data, sizeof(data), &locked));
+    TEST_CHECK(!locked);
+}
+
+// Every packet size parses the same, in one call or split at any point across calls
+static void test_packet_sizes()
+{
+    static const size_t sizes[] = { 188, 192, 204 }, chunks[] = { 1, 7, 100, 187, 188, 189, 203, 205, 1000, 100000 };
+    static uint8_t data[TEST_PACKETS * 204];
+    int seen[TEST_PACKETS];
+    ts_t ts;
+
+    for (int s = 0; s < 3; ++s) {
+        size_t size = test_put_stream(data, sizes[s]);
+
+        for (int c = 0; c < 10; ++c) {
+            ts_init(&ts);
+            int count = test_parse_chunked(&ts, data, size, chunks[c], seen);
+
+            TEST_CHECK(TEST_VIDEO_PACKETS == count);
+            TEST_CHECK(sizes[s] == ts.packet_size);
+
+            for (int k = 0; k < count; ++k) {
+                TEST_CHECK(k == seen[k]);
+            }
+        }
+    }
+}
+
+// A buffer that ends inside the parity or prefix after a packet's 188 bytes leaves the rest
+// in ts->skip, the next call starts by dropping it
+static void test_skip()
+{
+    static uint8_t data[TEST_PACKETS * 204];
+    ts_t ts;
+
+    test_put_stream(data, 204);
+    ts_init(&ts);
+
+    // PAT, PMT and the first video packet, missing 10 bytes of its parity
+    TEST_CHECK(3 * 204 - 10 == ts_parse_packets(&ts, data, 3 * 204 - 10));
+    TEST_CHECK(LIBCAPTION_READY == ts_status(&ts) && 0 == ts.data[0]);
+    TEST_CHECK(10 == ts.skip);
+
+    // Less than the rest of the parity, then the next packet
+    TEST_CHECK(4 == ts_parse_packets(&ts, &data[3 * 204 - 10], 4));
+    TEST_CHECK(LIBCAPTION_OK == ts_status(&ts) && 6 == ts.skip);
+    TEST_CHECK(6 + 204 == ts_parse_packets(&ts, &data[3 * 204 - 6], 6 + 204));
+    TEST_CHECK(LIBCAPTION_READY == ts_status(&ts) && 1 == ts.data[0] && 0 == ts.skip);
+
+    // READY stops after each video packet, calling again with the rest of the same buffer resumes the batch
+    size_t pos = 4 * 204, n;
+    for (int k = 2; k < 6; ++k, pos += n) {
+        n = ts_parse_packets(&ts, &data[pos], 8 * 204 - pos);
+        TEST_CHECK(204 == n && LIBCAPTION_READY == ts_status(&ts) && k == ts.data[0]);
+    }
+
+    TEST_CHECK(0 == ts_parse_packets(&ts, &data[pos], 0) && LIBCAPTION_OK == ts_status(&ts));
+}
+
+// Lost sync in the middle of a stream costs only the packets it hit
+static void test_lost_sync()
+{
+    static const size_t sizes[] = { 188, 192, 204 }, chunks[] = { 100, 1000, 100000 };
+    static uint8_t data[TEST_PACKETS * 204 + 100], stream[TEST_PACKETS * 204];
+    int seen[TEST_PACKETS];
+    ts_t ts;
+
+    for (int s = 0; s < 3; ++s) {
+        size_t stream_size = test_put_stream(stream, sizes[s]), drop = (2 + 20) * sizes[s] + 100, junk = (2 + 40) * sizes[s];
+
+        // A byte lost inside video packet 20, and junk with a stray sync byte in front of video packet 40
+        memcpy(data, stream, drop);
+        memcpy(&data[drop], &stream[drop + 1], junk - drop - 1);
+        memset(&data[junk - 1], 0x33, 50);
+        data[junk + 10] = TS_SYNC_BYTE;
+        memcpy(&data[junk + 49], &stream[junk], stream_size - junk);
+        size_t size = stream_size - 1 + 50;
+
+        for (int c = 0; c < 3; ++c) {
+            ts_init(&ts);
+            int count = test_parse_chunked(&ts, data, size, chunks[c], seen);
+
+            // Packet 20 itself is parsed, its damage is in the payload. Packet 21 starts before the point sync was lost
+            TEST_CHECK(TEST_VIDEO_PACKETS - 1 == count);
+            TEST_CHECK(sizes[s] == ts.packet_size);
+
+            for (int k = 0, expected = 0; k < count; ++k, ++expected) {
+                expected += 21 == expected;
+                TEST_CHECK(expected == seen[k]);
+            }
+        }
+    }
+}
+
+// Parses the test packets with one byte patched, returns the number of video packets found
+static int test_parse_patched(ts_t* ts, int packet, int offset, uint8_t value)
+{
+    static uint8_t packets[TEST_PACKETS][TS_PACKET_SIZE];
+    int seen[TEST_PACKETS];
+
+    test_put_packets(packets);
+    packets[packet][offset] = value;
+    ts_init(ts);
+    return test_parse_chunked(ts, &packets[0][0], sizeof(packets), sizeof(packets), seen);
+}
+
+// Only table_id 0x00 on the PAT PID and 0x02 on a PMT PID are parsed, and only when the
+// section fits in its packet
+static void test_sections()
+{
+    ts_t ts;
+
+    TEST_CHECK(TEST_VIDEO_PACKETS == test_parse_patched(&ts, 0, 4, 0));
+    TEST_CHECK(1 == ts.programs && 1 == ts.streams && TEST_PMT_PID == ts.pmtpid);
+
+    // byte 4 is the pointer_field, the section starts at byte 5
+    TEST_CHECK(0 == test_parse_patched(&ts, 0, 5, 0x02));
+    TEST_CHECK(0 == ts.programs && 0 == ts.streams);
+    TEST_CHECK(0 == test_parse_patched(&ts, 1, 5, 0x00));
+    TEST_CHECK(1 == ts.programs && 0 == ts.streams);
+    TEST_CHECK(0 == test_parse_patched(&ts, 1, 5, 0xFC));
+    TEST_CHECK(1 == ts.programs && 0 == ts.streams);
+
+    // A section_length reaching past the packet is skipped rather than cut short
+    TEST_CHECK(0 == test_parse_patched(&ts, 0, 7, 200));
+    TEST_CHECK(0 == ts.programs);
+    TEST_CHECK(0 == test_parse_patched(&ts, 1, 7, TS_PACKET_SIZE - 5 - 3 + 1));
+    TEST_CHECK(1 == ts.programs && 0 == ts.streams);
+    TEST_CHECK(TEST_VIDEO_PACKETS == test_parse_patched(&ts, 1, 7, TS_PACKET_SIZE - 5 - 3));
+    TEST_CHECK(1 == ts.streams);
+
+    // A pointer_field that leaves no room for the section header
+    TEST_CHECK(0 == test_parse_patched(&ts, 0, 4, TS_PACKET_SIZE - 5 - 2));
+    TEST_CHECK(0 == ts.programs);
+}
+
+int main(int argc, char** argv)
+{
+    test_find_sync();
+    test_resync();
+    test_packet_sizes();
+    test_skip();
+    test_lost_sync();
+    test_sections();
+    TEST_RESULT();
+}